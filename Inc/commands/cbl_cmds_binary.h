@@ -0,0 +1,42 @@
+/** @file cbl_cmds_binary.h
+ *
+ * @brief Binary framed protocol for automated flashing. Shell switches to it
+ *        when the host sends TXT_CMD_BINARY, frames are described in
+ *        cbl_frame.h
+ */
+#ifndef CBL_CMDS_BINARY_H
+#define CBL_CMDS_BINARY_H
+#include "etc/cbl_common.h"
+
+#define TXT_CMD_BINARY "\x16\x16" "bin" /*!< Magic sequence, SYN SYN "bin" */
+#define TXT_CMD_BINARY_HELP "<SYN><SYN>bin" /*!< Used in help function */
+
+#define BIN_PROTOCOL_VERSION 1u
+
+/* Parameters of every operation are listed after the opcode, all are little
+ * endian */
+typedef enum
+{
+    BIN_OP_PING = 0x00, /*!< Returns protocol version (1) */
+    BIN_OP_VERSION = 0x01, /*!< Returns bootloader version string */
+    BIN_OP_CID = 0x02, /*!< Returns chip ID (4) */
+    BIN_OP_GET_RDP_LVL = 0x03, /*!< Returns read protection string */
+    BIN_OP_GET_WRITE_PROT = 0x04, /*!< Returns write protection string */
+    BIN_OP_CHANGE_WRITE_PROT = 0x05, /*!< mask (4), enable (1) */
+    BIN_OP_FLASH_ERASE = 0x06, /*!< sector (1), count (1) */
+    BIN_OP_FLASH_ERASE_MASS = 0x07, /*!< No parameters */
+    BIN_OP_FLASH_WRITE = 0x08, /*!< address (4), data (rest of the body) */
+    BIN_OP_MEM_READ = 0x09, /*!< address (4), count (2), returns data */
+    BIN_OP_JUMP_TO = 0x0A, /*!< address (4), jumps after the response */
+    BIN_OP_UPDATE_NEW_START = 0x0B, /*!< length (4), erases new app. area */
+    BIN_OP_UPDATE_NEW_END = 0x0C, /*!< length (4), app_type_t (1), restarts
+     after the response */
+    BIN_OP_RESET = 0x0D, /*!< Restarts after the response */
+    BIN_OP_EXIT = 0x0E, /*!< Exits the bootloader after the response */
+    BIN_OP_TEXT = 0x0F /*!< Returns to the text shell after the response */
+} bin_op_t;
+
+cbl_err_code_t cmd_binary (parser_t * phPrsr);
+
+#endif /* CBL_CMDS_BINARY_H */
+/*** end of file ***/
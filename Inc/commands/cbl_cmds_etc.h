@@ -2,6 +2,14 @@
  *
  * @brief Commands that don't fall in no other category, but don't deserve their
  *        own file
+ *
+ * @note  set-baud needs from HAL:
+ *          - hal_baud_get(), hal_flow_ctrl_get() - Current UART settings
+ *          - hal_baud_check() - CBL_ERR_BAUD if UART can't do the rate or
+ *            RTS/CTS
+ *          - hal_baud_set() - Waits for transmission to complete, then
+ *            reconfigures UART. Continuous reception into RX ring keeps
+ *            running
  */
 #ifndef CBL_CMDS_ETC_H
 #define CBL_CMDS_ETC_H
@@ -9,9 +17,25 @@
 
 #define TXT_CMD_CID "cid"
 #define TXT_CMD_EXIT "exit"
+#define TXT_CMD_SET_BAUD "set-baud"
+
+#define TXT_PAR_SET_BAUD_RATE "rate"
+#define TXT_PAR_SET_BAUD_FLOW "flow"
+#define TXT_PAR_SET_BAUD_FLOW_HW "rts-cts"
+#define TXT_PAR_SET_BAUD_FLOW_NO "no"
+
+#define TXT_SET_BAUD_CONFIRM "confirm\r\n" /*!< Host sends it at new baud
+                                              rate */
+#define TXT_SET_BAUD_CONFIRM_HELP "confirm\\r\\n" /*!< Used in help
+                                                       function */
+#ifndef CBL_BAUD_CONFIRM_MS
+#define CBL_BAUD_CONFIRM_MS 1000u /*!< Time the host has to confirm new baud
+                                       rate */
+#endif
 
 cbl_err_code_t cmd_cid (parser_t * phPrsr);
 cbl_err_code_t cmd_exit (parser_t * phPrsr);
+cbl_err_code_t cmd_set_baud (parser_t * phPrsr);
 
 #endif /* CBL_CMDS_ETC_H */
 /*** end of file ***/
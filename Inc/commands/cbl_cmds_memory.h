@@ -7,32 +7,115 @@
 #include "etc/cbl_common.h"
 #include "etc/cbl_checksum.h"
 
-#define TXT_FLASH_WRITE_SZ "5120" /*!< Size of a buffer used to write to flash
-                                  as char array */
-#define FLASH_WRITE_SZ 5120 /*!< Size of a buffer used to write to flash */
-/* NOTE: Flash write size shall be divisible by 4 if CRC32 checksum is used*/
+#define TXT_FLASH_WRITE_SZ "5120" /*!< Default chunk size as char array */
+#define FLASH_WRITE_SZ 5120 /*!< Default chunk size */
+#define TXT_FLASH_WRITE_MAX_SZ "32768"
+#define FLASH_WRITE_MAX_SZ 32768 /*!< Size of the staging pool chunks are
+                                  written from, maximum chunk size */
+/* NOTE: Chunk size shall be divisible by 4 because of CRC32 checksum */
+#define TXT_FLASH_WRITE_MAX_WINDOW "4"
+#define FLASH_WRITE_MAX_WINDOW 4 /*!< Maximum number of chunks host can send
+                                  without waiting for acknowledge */
+#define FLASH_WRITE_SEQ_SZ 4 /*!< Size of a chunk sequence number in windowed
+                              transfer */
+#define TXT_FLASH_WRITE_MAX_RUNS "64"
+#define FLASH_WRITE_MAX_RUNS 64 /*!< Maximum number of runs in sparse transfer */
+#define FLASH_WRITE_RUN_SZ 8 /*!< Size of a run table entry */
+#define TXT_MEM_READ_MAX_FRAME "4096"
+#define MEM_READ_MAX_FRAME 4096 /*!< Maximum data in a frame of streamed read */
+#define MEM_READ_HDR_SZ 9 /*!< Type, offset and length of a streamed frame */
+#define MEM_READ_END 0xFFFFFFFFUL /*!< Host stops asking for frames with it */
+#define TXT_MEM_MAP_BLOCK_SZ "4096"
+#define MEM_MAP_BLOCK_SZ 4096 /*!< Default block size of digest map */
 
 #define TXT_CMD_JUMP_TO "jump-to"
 #define TXT_CMD_FLASH_ERASE "flash-erase"
 #define TXT_CMD_FLASH_WRITE "flash-write"
 #define TXT_CMD_MEM_READ "mem-read"
+#define TXT_CMD_MEM_HASH "mem-hash"
+#define TXT_CMD_MEM_MAP "mem-map"
 
 #define TXT_PAR_JUMP_TO_ADDR "addr"
 
 #define TXT_PAR_FLASH_WRITE_START "start"
 #define TXT_PAR_FLASH_WRITE_COUNT "count"
+#define TXT_PAR_FLASH_WRITE_WINDOW "window"
+#define TXT_PAR_FLASH_WRITE_CHUNK "chunk"
+#define TXT_PAR_FLASH_WRITE_COMPRESS "compress"
+#define TXT_PAR_FLASH_WRITE_ZCOUNT "zcount"
+#define TXT_PAR_FLASH_WRITE_RUNS "runs"
+#define TXT_PAR_FLASH_WRITE_DIFF "diff"
+#define TXT_PAR_FLASH_WRITE_ERASE "erase"
+#define TXT_PAR_FLASH_WRITE_ERASE_AUTO "auto"
+#define TXT_PAR_FLASH_WRITE_ERASE_NO "no"
+#define TXT_PAR_FLASH_WRITE_TRUE "true"
+#define TXT_PAR_FLASH_WRITE_FALSE "false"
+
+#define TXT_PAR_MEM_READ_FRAME "frame"
+
+#define TXT_PAR_MEM_HASH_ALGO "algo"
+#define TXT_PAR_MEM_MAP_BLOCK "block"
+
+#define TXT_COMPRESS_LZ4 "lz4"
+#define TXT_COMPRESS_NO "no"
 
 
 #define TXT_PAR_FLASH_ERASE_TYPE "type"
 #define TXT_PAR_FLASH_ERASE_SECT "sector"
 #define TXT_PAR_FLASH_ERASE_COUNT "count"
+#define TXT_PAR_FLASH_ERASE_START "start"
 #define TXT_PAR_FLASH_ERASE_TYPE_MASS "mass"
 #define TXT_PAR_FLASH_ERASE_TYPE_SECT "sector"
+#define TXT_PAR_FLASH_ERASE_TYPE_RANGE "range"
+
+typedef enum
+{
+    COMPRESS_NO = 0, /*!< Bytes are sent as they are written */
+    COMPRESS_LZ4 /*!< LZ4 frame */
+} compress_t;
+
+typedef enum
+{
+    ERASE_DEFAULT = 0, /*!< Erase parameter not given, command decides */
+    ERASE_NO, /*!< Sectors shall be erased before */
+    ERASE_AUTO /*!< Sector is erased the first time bytes land in it */
+} erase_t;
+
+/** Type of a frame of streamed read */
+typedef enum
+{
+    MEM_READ_DATA = 'D', /*!< Bytes as they are in memory */
+    MEM_READ_RUN = 'R', /*!< Bytes are all equal to the one byte sent */
+    MEM_READ_DONE = 'E' /*!< All frames were sent, host may ask for some of
+     them again */
+} mem_read_type_t;
+
+typedef struct
+{
+    uint32_t window; /*!< Chunks host sends without waiting for acknowledge,
+     0 for text handshake per chunk */
+    uint32_t chunk_sz; /*!< Size of every chunk except the last one */
+    compress_t compress; /*!< Compression of sent bytes */
+    uint32_t zlen; /*!< Number of compressed bytes sent */
+    uint32_t done; /*!< Bytes already written by an interrupted transfer,
+     only without compression */
+    bool is_journal; /*!< Progress is recorded to the journal */
+    uint32_t runs; /*!< Number of runs of sparse transfer, 0 if all bytes are
+     sent */
+    bool is_diff; /*!< Bytes already in flash are not programmed */
+    erase_t erase; /*!< Erasing of sectors, ERASE_AUTO can't be used with
+     'is_diff' */
+} flash_write_opt_t;
 
 cbl_err_code_t cmd_jump_to (parser_t * phPrsr);
 cbl_err_code_t cmd_flash_erase (parser_t * phPrsr);
 cbl_err_code_t cmd_flash_write (parser_t * phPrsr);
 cbl_err_code_t cmd_mem_read (parser_t * phPrsr);
-cbl_err_code_t flash_write (uint32_t start, uint32_t len, cksum_t cksum);
+cbl_err_code_t cmd_mem_hash (parser_t * phPrsr);
+cbl_err_code_t cmd_mem_map (parser_t * phPrsr);
+cbl_err_code_t flash_write (uint32_t start, uint32_t len, cksum_t cksum,
+        const flash_write_opt_t * p_opt);
+cbl_err_code_t flash_write_get_opts (parser_t * ph_prsr,
+        flash_write_opt_t * p_opt);
 #endif /* CBL_CMDS_MEMORY_H */
 /*** end of file ***/
@@ -10,10 +10,17 @@
 
 #define TXT_CMD_UPDATE_NEW "update-new"
 #define TXT_PAR_UP_NEW_COUNT "count"
+#define TXT_PAR_UP_NEW_RESUME "resume"
+#define TXT_PAR_UP_NEW_TRUE "true"
+#define TXT_PAR_UP_NEW_FALSE "false"
 /* Also takes checksum parameter from cbl_checksum.h */
 /* Also takes application type parameter from cbl_boot_record.h */
 
 cbl_err_code_t cmd_update_new (parser_t * phPrsr);
+cbl_err_code_t update_new_erase (uint32_t len);
+cbl_err_code_t update_new_check (uint32_t len, app_type_t app_type);
+cbl_err_code_t update_new_set_ready (uint32_t len, cksum_t cksum,
+        app_type_t app_type);
 
 #endif /* CBL_CMDS_UPDATE_NEW_H */
 /*** end of file ***/
@@ -13,6 +13,9 @@
 #include <stdlib.h>
 
 #define CBL_VERSION "v1.1"
+#define CBL_PROTOCOL_VERSION "3" /*!< Incremented when a change breaks
+                                      hosts written for the previous one,
+                                      added features are announced by caps */
 
 #define CBL_ADDR_USERAPP 0x08010000UL /*!< Address to MSP of user application */
 
@@ -59,7 +62,39 @@ typedef enum
     CBL_ERR_INV_HEX, /*!< Invalid hex value character given to the function */
     CBL_ERR_SEGMEN, /*!< Tried accessing forbidden address */
     CBL_ERR_IHEX_FCN, /*!< Invalid intel hex function requested */
-    CBL_ERR_INV_IHEX /*!< Invalid intel hex function */
+    CBL_ERR_INV_IHEX, /*!< Invalid intel hex function */
+    CBL_ERR_WINDOW, /*!< Invalid window size for streamed transfer */
+    CBL_ERR_CHUNK_SEQ, /*!< Chunk received out of order */
+    CBL_ERR_FRAME_LEN, /*!< Binary frame is too long */
+    CBL_ERR_FRAME_CRC, /*!< Binary frame has invalid CRC */
+    CBL_ERR_FRAME_OP, /*!< Binary frame has unknown opcode */
+    CBL_ERR_RX_OVERRUN, /*!< RX ring overflowed, received bytes were lost */
+    CBL_ERR_RX_TIMEOUT, /*!< Host didn't send expected bytes in time */
+    CBL_ERR_CHUNK_SZ, /*!< Invalid chunk size for flash write */
+    CBL_ERR_BAUD, /*!< Baud rate or flow control not supported by UART */
+    CBL_ERR_BAUD_CONFIRM, /*!< Host didn't confirm new baud rate */
+    CBL_ERR_COMPRESS, /*!< Unknown compression requested */
+    CBL_ERR_DECOMP, /*!< Compressed data is corrupted or decompresses to
+                        different length */
+    CBL_ERR_INV_PATCH, /*!< Patch is corrupted */
+    CBL_ERR_PATCH_BASE, /*!< Patch is not made for the active application */
+    CBL_ERR_PATCH_DIGEST, /*!< Application rebuilt from patch has wrong
+                              digest */
+    CBL_ERR_PAR_RESUME, /*!< Value of parameter resume is undefined */
+    CBL_ERR_NO_JOURNAL, /*!< There is no interrupted transfer to resume */
+    CBL_ERR_SPARSE, /*!< Invalid run table or sparse transfer options */
+    CBL_ERR_PAR_DIFF, /*!< Value of parameter diff is undefined */
+    CBL_ERR_NOT_ERASED, /*!< Flash differs from data and is not erased */
+    CBL_ERR_READ_FRAME, /*!< Invalid frame size of streamed read */
+    CBL_ERR_READ_RESEND, /*!< Host asked for a frame that wasn't sent */
+    CBL_ERR_HASH_LEN, /*!< Count is not a multiple of the checksum's length
+     multiple, checksum_get_multiple() */
+    CBL_ERR_MAP_BLOCK, /*!< Block size of digest map is 0 or not divisible
+     by checksum_get_multiple() */
+    CBL_ERR_SLOT_EMPTY, /*!< Other slot holds no application to start */
+    CBL_ERR_ERASE_RANGE, /*!< Range to erase is not inside of flash */
+    CBL_ERR_PAR_ERASE /*!< Erase parameter has wrong value or is used with
+     differential transfer */
 } cbl_err_code_t;
 
 void CBL_hal_init(void);
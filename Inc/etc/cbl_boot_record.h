@@ -1,48 +1,83 @@
 /** @file cbl_boot_record.h
  *
  * @brief Boot record hold useful data about current version of user application
- *        and of a new one, if it is available
+ *        and of a new one, if it is available.
+ *
+ *        Boot record is kept as a log in the first BOOT_RECORD_LOG_SZ bytes of
+ *        its sector. Every version is appended as an entry:
+ *
+ *        | sequence (4) | CRC32 (4) | boot_record_t |
+ *
+ *        Newest entry with correct CRC32 is the boot record. Sector is erased
+ *        only when the log is full, then the newest entry is written first.
+ *        With CBL_AB_SLOTS 'act_slot' is copied to retained memory before, so
+ *        power loss in between still starts the same slot.
  */
 #ifndef CBL_BOOT_RECORD_H
 #define CBL_BOOT_RECORD_H
 #include <stdbool.h>
 #include "cbl_common.h"
 #include "cbl_checksum.h"
+#include "cbl_flash.h"
 
-/* These values are from linker file ***.ld */
+/* These values are from linker file ***.ld. Every area shall start on a
+ * sector start, its sectors are looked up in flash geometry (cbl_flash.h) */
 #define BOOT_RECORD_START 0x800C000UL
-#define BOOT_RECORD_SECTOR 3
-#define BOOT_RECORD_MAX_SECTORS 1
+#define BOOT_RECORD_SECTOR_SZ (16 * 1024)
+#define BOOT_RECORD_LOG_SZ (12 * 1024) /*!< Rest of the sector is journal */
+#define BOOT_RECORD_NO_SEQ 0xFFFFFFFFUL /*!< There is no boot record */
 
 #define BOOT_ACT_APP_START 0x08010000UL
 #define BOOT_ACT_APP_MAX_LEN (448 * 1024)
-#define BOOT_ACT_APP_START_SECTOR 4
-#define BOOT_ACT_APP_MAX_SECTORS 4
 
 #define IS_ACT_APP_ADDRESS(ADDR) (((ADDR) >= (BOOT_ACT_APP_START)) && \
         ((ADDR) <= ((BOOT_ACT_APP_START) + (BOOT_ACT_APP_MAX_LEN) - 1)))
 
 #define BOOT_NEW_APP_START 0x08080000UL
 #define BOOT_NEW_APP_MAX_LEN (512 * 1024)
-#define BOOT_NEW_APP_START_SECTOR 8
-#define BOOT_NEW_APP_MAX_SECTORS 4
+
+/** Patched application is rebuilt into new application sectors following the
+ *  patch, starting at this address */
+#define BOOT_PATCH_REBUILD_START(PATCH_LEN) \
+    flash_get_sector_end((BOOT_NEW_APP_START) + (PATCH_LEN) - 1)
 
 #define IS_NEW_APP_ADDRESS(ADDR) (((ADDR) >= (BOOT_NEW_APP_START)) && \
         ((ADDR) <= ((BOOT_NEW_APP_START) + (BOOT_NEW_APP_MAX_LEN) - 1)))
 
+#ifndef CBL_AB_SLOTS
+#define CBL_AB_SLOTS 0 /*!< 1 starts application from either slot, new one is
+                            written to the other slot and activated without
+                            copying it */
+#endif
+
+/* Slot A is active application area, slot B new application area. Without
+ * CBL_AB_SLOTS application is always started from slot A. */
+#define BOOT_SLOT_START(SLOT) \
+    ((BOOT_SLOT_A == (SLOT)) ? BOOT_ACT_APP_START : BOOT_NEW_APP_START)
+#define BOOT_SLOT_MAX_LEN(SLOT) \
+    ((BOOT_SLOT_A == (SLOT)) ? BOOT_ACT_APP_MAX_LEN : BOOT_NEW_APP_MAX_LEN)
+
 #define TXT_PAR_APP_TYPE "type"
 #define TXT_PAR_APP_TYPE_BIN "bin"
 #define TXT_PAR_APP_TYPE_HEX "hex"
 #define TXT_PAR_APP_TYPE_SREC "srec"
+#define TXT_PAR_APP_TYPE_PATCH "patch"
 
 typedef enum
 {
     TYPE_UNDEF = 0,
     TYPE_BIN,
     TYPE_HEX,
-    TYPE_SREC
+    TYPE_SREC,
+    TYPE_PATCH /*!< Patch of active application, see cbl_patch.h */
 } app_type_t;
 
+typedef enum
+{
+    BOOT_SLOT_A = 0,
+    BOOT_SLOT_B
+} boot_slot_t;
+
 typedef struct
 {
     /*WARNING: Size of 4 bytes assumed */
@@ -54,16 +89,26 @@ typedef struct
 
 typedef struct
 {
-    bool is_new_app_ready; /* WARNING: Size of 1 byte assumed */
+    bool is_new_app_ready; /* WARNING: Size of 1 byte assumed. Not used,
+     pending update is kept in retained memory, see cbl_retained.h */
     app_meta_t act_app; /*!< Active application meta data */
     app_meta_t new_app; /*!< New application meta data */
     uint32_t key; /*!< Used to check if boot_record was initialized.
      Boot record user shall ignore */
-    uint8_t reserved[255];
+    uint8_t new_app_digest[32]; /*!< sha256 of application rebuilt from
+     TYPE_PATCH new application */
+    /*WARNING: Size of 4 bytes assumed */
+    boot_slot_t act_slot; /*!< Slot application is started from, with
+     CBL_AB_SLOTS 'new_app' is the application in the other slot */
+    uint8_t reserved[219];
 } boot_record_t;
 
 boot_record_t * boot_record_get (void);
 cbl_err_code_t boot_record_set (boot_record_t * p_new_boot_record);
+uint32_t boot_record_get_seq (void);
+cbl_err_code_t boot_record_compact (void);
+boot_slot_t boot_record_get_act_slot (void);
+boot_slot_t boot_record_get_new_slot (void);
 cbl_err_code_t enum_app_type (char *char_app_type, uint32_t len,
         app_type_t * p_app_type);
 
@@ -5,7 +5,7 @@
 #ifndef CBL_CHECKSUM_H
 #define CBL_CHECKSUM_H
 #include "cbl_common.h"
-#include "sha256.h"
+#include "cbl_sha256.h"
 
 typedef enum
 {
@@ -20,24 +20,81 @@ typedef enum
 #define TXT_CKSUM_CRC "crc32"
 #define TXT_CKSUM_NO "no"
 
+#ifndef CBL_CRC32_SW
+#define CBL_CRC32_SW 0 /*!< 1 to calculate CRC32 in software (slice-by-8)
+                            instead of with the CRC peripheral */
+#endif
+
+#if 1 == CBL_CRC32_SW
+#define CRC32_LEN_MULTIPLE 1u /*!< Software CRC32 takes any length */
+#else
+#define CRC32_LEN_MULTIPLE 4u /*!< CRC peripheral takes whole words */
+#endif
+
+#ifndef CBL_CKSUM_USE_SHA256
+#define CBL_CKSUM_USE_SHA256 1 /*!< 0 leaves sha256 checksum out */
+#endif
+
+#ifndef CBL_CKSUM_USE_CRC32
+#define CBL_CKSUM_USE_CRC32 1 /*!< 0 leaves CRC32 checksum out */
+#endif
+
+#if 1 == CBL_CKSUM_USE_SHA256
+#define TXT_CKSUM_LIST_SHA256 TXT_CKSUM_SHA256 ","
+#else
+#define TXT_CKSUM_LIST_SHA256 ""
+#endif
+#if 1 == CBL_CKSUM_USE_CRC32
+#define TXT_CKSUM_LIST_CRC TXT_CKSUM_CRC ","
+#else
+#define TXT_CKSUM_LIST_CRC ""
+#endif
+/** Checksums built in, separated with ',' */
+#define TXT_CKSUM_LIST TXT_CKSUM_LIST_SHA256 TXT_CKSUM_LIST_CRC TXT_CKSUM_NO
+
+#define CKSUM_MAX_DIGEST_SZ 32u /*!< Longest checksum of all providers */
+
+/** State of a checksum being calculated, large enough for any provider */
+typedef union
+{
+#if 1 == CBL_CKSUM_USE_SHA256
+    sha_ctx_t sha256;
+#endif
+    uint32_t crc32; /*!< Used by software CRC32 */
+} cksum_ctx_t;
+
+/** Checksum provider, every one is in its own cbl_cksum_*.c file and listed
+ *  in the provider table in cbl_checksum.c */
+typedef struct
+{
+    cksum_t id;
+    const char *name; /*!< Value of checksum parameter */
+    uint32_t digest_len; /*!< Length of the checksum host sends */
+    uint32_t len_multiple; /*!< Length of data shall be divisible by it */
+    void (*init) (cksum_ctx_t * p_ctx);
+    cbl_err_code_t (*update) (cksum_ctx_t * p_ctx, const uint8_t * buf,
+            uint32_t len);
+    void (*final) (cksum_ctx_t * p_ctx, uint8_t * p_digest); /*!< Writes the
+     checksum in the byte order host sends it with */
+} cksum_provider_t;
+
+#if 1 == CBL_CKSUM_USE_SHA256
+extern const cksum_provider_t cksum_sha256;
+#endif
+#if 1 == CBL_CKSUM_USE_CRC32
+extern const cksum_provider_t cksum_crc32;
+#endif
+
 cbl_err_code_t enum_checksum (char * checksum, uint32_t len, cksum_t * p_cksum);
-void init_checksum (cksum_t cksum, SHA256_CTX * ph_sha256);
+void init_checksum (cksum_t cksum, cksum_ctx_t * p_ctx);
 cbl_err_code_t accumulate_checksum (uint8_t * buf, uint32_t len, cksum_t cksum,
-        SHA256_CTX * ph_sha256);
-cbl_err_code_t accumulate_crc32 (uint8_t * buf, uint32_t len);
-cbl_err_code_t accumulate_sha256 (uint8_t * buf, uint32_t len,
-        SHA256_CTX * ph_sha256);
-cbl_err_code_t verify_checksum (uint8_t * buf, uint32_t len, cksum_t cksum,
-        SHA256_CTX * ph_sha256);
-cbl_err_code_t verify_crc32 (uint8_t * p_recv_cksum, uint32_t cksum_len);
-cbl_err_code_t verify_sha256 (uint8_t * p_recv_cksum, uint32_t cksum_len,
-        SHA256_CTX * ph_sha256);
+        cksum_ctx_t * p_ctx);
+cbl_err_code_t verify_checksum (uint8_t * p_recv_cksum, uint32_t cksum_len,
+        cksum_t cksum, cksum_ctx_t * p_ctx);
 uint32_t checksum_get_length(cksum_t cksum);
-#if 0
-cbl_err_code_t verify_checksum_old (uint8_t * buf, uint32_t len, cksum_t cksum);
-cbl_err_code_t verify_crc_old (uint8_t * write_buf, uint32_t len);
-cbl_err_code_t verify_sha256_old (uint8_t * buf, uint32_t len);
-#endif
+uint32_t checksum_get_multiple (cksum_t cksum);
+cbl_err_code_t final_checksum (cksum_t cksum, cksum_ctx_t * p_ctx,
+        uint8_t * p_digest);
 
 #endif /* CBL_CHECKSUM_H */
 /*** end of file ***/
@@ -0,0 +1,18 @@
+/** @file cbl_crc32.h
+ *
+ * @brief Small CRC32 (reflected 0xEDB88320, as zlib) of short records, a
+ *        nibble at a time. It doesn't depend on HAL and checksum providers,
+ *        so it can be linked into the user application, transfers use
+ *        cbl_checksum.h instead.
+ *
+ * @note  This file is part of custom bootloader, but is also included in the
+ *        user application
+ */
+#ifndef CBL_CRC32_H
+#define CBL_CRC32_H
+#include <stdint.h>
+
+uint32_t crc32_calc (uint32_t crc, const void * buf, uint32_t len);
+
+#endif /* CBL_CRC32_H */
+/*** end of file ***/
@@ -0,0 +1,47 @@
+/** @file cbl_flash.h
+ *
+ * @brief Comparing flash with data before it is programmed, so bytes that
+ *        already match are neither erased nor programmed again. Geometry of
+ *        flash sectors, so only sectors a range overlaps are erased.
+ */
+#ifndef CBL_FLASH_H
+#define CBL_FLASH_H
+#include "cbl_common.h"
+
+#define FLASH_ERASED_BYTE 0xFFu
+#define FLASH_ERASED_WORD 0xFFFFFFFFUL
+
+/* Sectors of STM32F4 parts with 1 MiB of flash, from the reference manual:
+ * 4 of 16 KiB, 1 of 64 KiB and 7 of 128 KiB */
+#define FLASH_START 0x08000000UL
+#define FLASH_SZ (1024 * 1024)
+#define FLASH_SECTORS 12
+#define FLASH_GRANULE_SZ (16 * 1024) /*!< Smallest sector, sizes and starts of
+                                          all sectors are its multiples */
+#define FLASH_NO_SECTOR 0xFFFFFFFFUL /*!< Address is not in flash */
+
+typedef struct
+{
+    uint32_t start; /*!< Address of the first byte of the sector */
+    uint32_t len; /*!< Size of the sector in bytes */
+} flash_sector_t;
+
+typedef enum
+{
+    FLASH_CMP_EQUAL = 0, /*!< Flash already holds the data */
+    FLASH_CMP_PROGRAM, /*!< Bytes that differ are erased, data can be
+     programmed */
+    FLASH_CMP_ERASE /*!< Flash shall be erased before programming */
+} flash_cmp_t;
+
+flash_cmp_t flash_compare (uint32_t addr, const uint8_t * buf, uint32_t len);
+bool flash_is_erased (uint32_t addr, uint32_t len);
+cbl_err_code_t flash_program_diff (uint32_t addr, uint8_t * buf, uint32_t len,
+        uint32_t * p_skipped);
+uint32_t flash_get_sector (uint32_t addr);
+const flash_sector_t * flash_get_sector_info (uint32_t sector);
+uint32_t flash_get_sector_end (uint32_t addr);
+cbl_err_code_t flash_erase (uint32_t addr, uint32_t len);
+
+#endif /* CBL_FLASH_H */
+/*** end of file ***/
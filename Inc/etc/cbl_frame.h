@@ -0,0 +1,40 @@
+/** @file cbl_frame.h
+ *
+ * @brief Frames used by the binary protocol. Every frame in both directions
+ *        has the form:
+ *
+ *        | sync | length (2) | opcode | body (length bytes) | CRC16 (2) |
+ *
+ *        Multi-byte fields are little endian. CRC16 is CRC-16/CCITT-FALSE
+ *        calculated over length, opcode and body. Response has the opcode of
+ *        the request with FRAME_RESP_FLAG set and its body starts with the
+ *        status byte (cbl_err_code_t).
+ */
+#ifndef CBL_FRAME_H
+#define CBL_FRAME_H
+#include "cbl_common.h"
+
+#define FRAME_SYNC 0xA5u /*!< First byte of every frame */
+#define FRAME_HDR_SZ 4u /*!< Sync, length and opcode */
+#define FRAME_CRC_SZ 2u /*!< CRC16 on the end of the frame */
+#define FRAME_MAX_DATA 4096u /*!< Maximum data carried by one frame */
+#define FRAME_MAX_BODY (FRAME_MAX_DATA + 8u) /*!< Data and its parameters */
+#define FRAME_RESP_FLAG 0x80u /*!< Set in the opcode of a response */
+
+typedef struct
+{
+    uint8_t opcode; /*!< Requested operation */
+    uint16_t len; /*!< Length of the body */
+    uint8_t *p_body; /*!< Parameters of the operation */
+} frame_t;
+
+cbl_err_code_t frame_recv (frame_t * p_frame);
+cbl_err_code_t frame_send (uint8_t opcode, cbl_err_code_t status,
+        const uint8_t * p_data, uint32_t len);
+uint16_t frame_get_ui16 (const uint8_t * buf);
+uint32_t frame_get_ui32 (const uint8_t * buf);
+void frame_put_ui32 (uint8_t * buf, uint32_t num);
+uint16_t frame_crc16 (uint16_t crc, const uint8_t * buf, uint32_t len);
+
+#endif /* CBL_FRAME_H */
+/*** end of file ***/
@@ -0,0 +1,44 @@
+/** @file cbl_journal.h
+ *
+ * @brief Journal of new application transfer progress, so an interrupted
+ *        update-new can be resumed. Journals are appended one after another
+ *        in the boot record sector after the boot record log.
+ *
+ *        | magic "JRNL" | boot record sequence (4) | length (4) |
+ *        | checksum (4) | app type (4) | written (4) | written (4) | ...
+ *
+ *        Every chunk written to flash appends the number of bytes written so
+ *        far, the last one is the progress. Only the last journal is valid and
+ *        only while the boot record it was started with is the newest, so
+ *        writing the boot record clears it without an erase. Without writing
+ *        the boot record it is cleared by appending "JCLR". Sector is
+ *        compacted when a new journal has no room left. Magic is written
+ *        last, a header slot with the magic erased but other words written
+ *        was interrupted and is skipped, it is never written again.
+ */
+#ifndef CBL_JOURNAL_H
+#define CBL_JOURNAL_H
+#include "cbl_common.h"
+#include "cbl_boot_record.h"
+
+#define JOURNAL_START (BOOT_RECORD_START + BOOT_RECORD_LOG_SZ)
+#define JOURNAL_END (BOOT_RECORD_START + BOOT_RECORD_SECTOR_SZ)
+#define JOURNAL_MAGIC 0x4C4E524AUL /*!< "JRNL" read as little endian */
+#define JOURNAL_CLEAR 0x524C434AUL /*!< "JCLR" read as little endian */
+#define JOURNAL_MIN_FREE 1024u /*!< New journal needs that many free bytes,
+                                    else the sector is compacted first */
+
+typedef struct
+{
+    uint32_t len; /*!< Length of new application */
+    cksum_t cksum; /*!< Checksum used for the transfer */
+    app_type_t app_type; /*!< Type of new application */
+} journal_xfer_t;
+
+cbl_err_code_t journal_start (const journal_xfer_t * p_xfer);
+cbl_err_code_t journal_get (journal_xfer_t * p_xfer, uint32_t * p_done);
+cbl_err_code_t journal_commit (uint32_t done);
+cbl_err_code_t journal_clear (void);
+
+#endif /* CBL_JOURNAL_H */
+/*** end of file ***/
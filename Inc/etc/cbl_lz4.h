@@ -0,0 +1,69 @@
+/** @file cbl_lz4.h
+ *
+ * @brief Streaming decoder of LZ4 frames, as made by the lz4 command line
+ *        tool. Input is fed in pieces of any size, decompressed bytes are
+ *        passed to the output function in pieces of LZ4_OUT_SZ.
+ *
+ *        Matches reach up to 64 KiB back. Decompressed bytes are written to
+ *        memory mapped flash, so they are read back from there instead of
+ *        keeping the history in RAM.
+ *
+ * @note  Header, block and content checksums (xxHash) are skipped, transfer is
+ *        protected with the checksum of decompressed bytes. Dictionaries and
+ *        skippable frames are not supported.
+ */
+#ifndef CBL_LZ4_H
+#define CBL_LZ4_H
+#include "cbl_common.h"
+
+#define LZ4_OUT_SZ 4096u /*!< Decompressed bytes buffered before output, shall
+                              be divisible by 4 because of CRC32 */
+
+/** Receives decompressed bytes, 'addr' is where they belong */
+typedef cbl_err_code_t (*lz4_out_t) (uint32_t addr, uint8_t * buf,
+        uint32_t len, void * p_ctx);
+
+typedef enum
+{
+    LZ4_ST_MAGIC = 0, /*!< Frame magic number */
+    LZ4_ST_FLG, /*!< Frame descriptor flags */
+    LZ4_ST_BD, /*!< Frame descriptor block maximum size */
+    LZ4_ST_SKIP, /*!< Ignored bytes, then 'next' state */
+    LZ4_ST_BLK_SIZE, /*!< Block size or end mark */
+    LZ4_ST_BLK_RAW, /*!< Data of uncompressed block */
+    LZ4_ST_TOKEN, /*!< Literal and match length of a sequence */
+    LZ4_ST_LIT_LEN, /*!< Additional literal length bytes */
+    LZ4_ST_LIT, /*!< Literals */
+    LZ4_ST_OFFSET, /*!< Match offset */
+    LZ4_ST_MATCH_LEN, /*!< Additional match length bytes */
+    LZ4_ST_DONE /*!< Whole frame decoded */
+} lz4_state_t;
+
+typedef struct
+{
+    lz4_state_t state;
+    lz4_state_t next; /*!< State after LZ4_ST_SKIP */
+    uint8_t flg; /*!< Frame descriptor flags */
+    uint32_t field; /*!< Multi-byte field being received, little endian */
+    uint32_t field_len; /*!< Bytes of 'field' received */
+    uint32_t skip; /*!< Bytes left to skip */
+    uint32_t blk_left; /*!< Bytes left in current block */
+    uint32_t lit_len; /*!< Literals left in current sequence */
+    uint32_t match_len; /*!< Length of current match */
+    uint32_t start; /*!< Address of the first decompressed byte */
+    uint32_t max_len; /*!< Maximum number of decompressed bytes */
+    uint32_t out_done; /*!< Decompressed bytes passed to 'out' */
+    uint32_t out_len; /*!< Decompressed bytes in 'out_buf' */
+    lz4_out_t out; /*!< Output function */
+    void *p_ctx; /*!< Passed to 'out' */
+    uint8_t out_buf[LZ4_OUT_SZ];
+} lz4_dec_t;
+
+void lz4_init (lz4_dec_t * p_dec, uint32_t start, uint32_t max_len,
+        lz4_out_t out, void * p_ctx);
+cbl_err_code_t lz4_feed (lz4_dec_t * p_dec, const uint8_t * p_in,
+        uint32_t len);
+cbl_err_code_t lz4_finish (lz4_dec_t * p_dec, uint32_t * p_len);
+
+#endif /* CBL_LZ4_H */
+/*** end of file ***/
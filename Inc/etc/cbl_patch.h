@@ -0,0 +1,41 @@
+/** @file cbl_patch.h
+ *
+ * @brief Binary patches (bsdiff style) that rebuild a new application from the
+ *        active one. Patch has the form, all fields little endian:
+ *
+ *        | magic "CBLP" | old length (4) | new length (4) |
+ *        | old sha256 (32) | new sha256 (32) | records |
+ *
+ *        Every record is:
+ *
+ *        | diff length (4) | extra length (4) | adjust (4, signed) |
+ *        | diff bytes | extra bytes |
+ *
+ *        Diff bytes are added (modulo 256) to the same number of old bytes,
+ *        extra bytes are copied as they are. After the record position in the
+ *        old application moves by 'adjust'.
+ */
+#ifndef CBL_PATCH_H
+#define CBL_PATCH_H
+#include "cbl_common.h"
+#include "cbl_sha256.h"
+
+#define PATCH_MAGIC 0x504C4243UL /*!< "CBLP" read as little endian */
+#define PATCH_HDR_SZ (12u + 2u * SHA256_BLOCK_SIZE)
+#define PATCH_REC_HDR_SZ 12u
+
+typedef struct
+{
+    uint32_t old_len; /*!< Length of the application patch applies to */
+    uint32_t new_len; /*!< Length of the rebuilt application */
+    uint8_t old_digest[SHA256_BLOCK_SIZE]; /*!< sha256 of the old one */
+    uint8_t new_digest[SHA256_BLOCK_SIZE]; /*!< sha256 of the rebuilt one */
+} patch_hdr_t;
+
+cbl_err_code_t patch_get_header (uint32_t patch_addr, uint32_t patch_len,
+        patch_hdr_t * p_hdr);
+cbl_err_code_t patch_apply (uint32_t patch_addr, uint32_t patch_len,
+        uint32_t old_addr, uint32_t new_addr, const uint8_t * p_digest);
+
+#endif /* CBL_PATCH_H */
+/*** end of file ***/
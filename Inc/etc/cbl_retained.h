@@ -0,0 +1,43 @@
+/** @file cbl_retained.h
+ *
+ * @brief State that changes on every update or start, kept in memory that
+ *        survives reset (backup SRAM or RTC backup registers) instead of
+ *        flash. Block is protected with CRC32, when it is lost all flags are
+ *        cleared and boot counter starts from 0.
+ *
+ *        HAL shall:
+ *          - Read 'len' bytes of retained memory in hal_retained_read()
+ *          - Write 'len' bytes of retained memory in hal_retained_write()
+ *
+ * @note  This file is part of custom bootloader, but is also included in the
+ *        user application, which may request the bootloader with
+ *        RETAINED_ENTER_BL and reset the boot counter
+ */
+#ifndef CBL_RETAINED_H
+#define CBL_RETAINED_H
+#include "cbl_common.h"
+
+#define RETAINED_MAGIC 0x4E544552UL /*!< "RETN" read as little endian */
+
+#define RETAINED_NEW_APP_READY 0x01UL /*!< New application is ready to be
+                                           copied to active application */
+#define RETAINED_ENTER_BL 0x02UL /*!< Application requests the bootloader
+                                      shell on the next start */
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t flags; /*!< RETAINED_* flags */
+    uint32_t boot_cnt; /*!< Starts of bootloader since it was reset */
+    uint32_t act_slot; /*!< Copy of boot record 'act_slot', used while boot
+                            record sector is erased, see cbl_boot_record.h */
+    uint32_t crc; /*!< CRC32 of the fields before */
+} retained_t;
+
+void retained_get (retained_t * p_ret);
+cbl_err_code_t retained_set (retained_t * p_ret);
+bool retained_flag_get (uint32_t flag);
+cbl_err_code_t retained_flag_set (uint32_t flag, bool is_set);
+
+#endif /* CBL_RETAINED_H */
+/*** end of file ***/
@@ -0,0 +1,33 @@
+/** @file cbl_rx_ring.h
+ *
+ * @brief Ring buffer for bytes received from the host. HAL receives bytes
+ *        continuously (circular DMA or RXNE interrupt) and feeds them from
+ *        the interrupt, bootloader consumes them from the main loop. One
+ *        producer and one consumer, so no locking is needed.
+ *
+ *        HAL shall:
+ *          - Start continuous reception into the given buffer in
+ *            hal_recv_from_host_circular_start()
+ *          - For circular DMA: call rx_ring_isr_update() from DMA half and
+ *            full transfer interrupts and UART idle line interrupt
+ *          - For RXNE interrupt: call rx_ring_isr_put() for every byte
+ */
+#ifndef CBL_RX_RING_H
+#define CBL_RX_RING_H
+#include "cbl_common.h"
+#include "cbl_wait.h"
+
+#define TXT_RX_RING_SZ "32768"
+#define RX_RING_SZ 32768u /*!< Size of the ring, shall be power of 2 */
+
+cbl_err_code_t rx_ring_start (void);
+uint32_t rx_ring_count (void);
+uint32_t rx_ring_read (uint8_t * buf, uint32_t len);
+cbl_err_code_t rx_ring_recv (uint8_t * buf, uint32_t len,
+        uint32_t timeout_ms);
+void rx_ring_flush (void);
+void rx_ring_isr_update (uint32_t pos);
+void rx_ring_isr_put (uint8_t byte);
+
+#endif /* CBL_RX_RING_H */
+/*** end of file ***/
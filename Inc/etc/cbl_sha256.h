@@ -0,0 +1,60 @@
+/** @file cbl_sha256.h
+ *
+ * @brief SHA-256 used by checksums and patches. Backend is chosen with
+ *        CBL_SHA256_BACKEND:
+ *          - CBL_SHA256_LIB - Generic sha256.h library
+ *          - CBL_SHA256_SW  - Software implementation in cbl_sha256.c with
+ *                             unrolled rounds, whole blocks are hashed
+ *                             straight from the input, default
+ *          - CBL_SHA256_HW  - HASH peripheral of parts that have one, HAL
+ *                             shall implement:
+ *              - hal_sha256_start() - Starts a new digest
+ *              - hal_sha256_accumulate() - Feeds bytes, length is always
+ *                divisible by 4
+ *              - hal_sha256_finish() - Feeds the last 0-3 bytes given to
+ *                it and writes the digest
+ *
+ * @note  HASH peripheral holds one digest, with CBL_SHA256_HW only one
+ *        context may be in use at a time
+ */
+#ifndef CBL_SHA256_H
+#define CBL_SHA256_H
+#include "cbl_common.h"
+
+#define CBL_SHA256_LIB 0
+#define CBL_SHA256_SW 1
+#define CBL_SHA256_HW 2
+
+#ifndef CBL_SHA256_BACKEND
+#define CBL_SHA256_BACKEND CBL_SHA256_SW
+#endif
+
+#if CBL_SHA256_LIB == CBL_SHA256_BACKEND
+#include "sha256.h"
+#else
+#define SHA256_BLOCK_SIZE 32 /*!< Size of the digest, named as in sha256.h */
+#endif
+
+#define SHA256_DATA_SZ 64u /*!< Bytes compressed at once */
+
+typedef struct
+{
+#if CBL_SHA256_LIB == CBL_SHA256_BACKEND
+    SHA256_CTX lib; /*!< State of the library */
+#elif CBL_SHA256_SW == CBL_SHA256_BACKEND
+    uint32_t state[8]; /*!< Hash of blocks compressed so far */
+    uint8_t buf[SHA256_DATA_SZ]; /*!< Bytes of an incomplete block */
+    uint32_t buf_len; /*!< Number of bytes in 'buf' */
+    uint64_t len; /*!< Number of bytes hashed */
+#else
+    uint8_t buf[4]; /*!< Bytes of an incomplete word */
+    uint32_t buf_len; /*!< Number of bytes in 'buf' */
+#endif
+} sha_ctx_t;
+
+void sha_init (sha_ctx_t * p_ctx);
+void sha_update (sha_ctx_t * p_ctx, const uint8_t * buf, uint32_t len);
+void sha_final (sha_ctx_t * p_ctx, uint8_t * p_digest);
+
+#endif /* CBL_SHA256_H */
+/*** end of file ***/
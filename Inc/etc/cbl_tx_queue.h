@@ -0,0 +1,32 @@
+/** @file cbl_tx_queue.h
+ *
+ * @brief Queue for bytes sent to the host. Sending returns as soon as bytes
+ *        are copied to the queue, HAL transmits them in the background (DMA
+ *        or TXE interrupt). Responses queued while a transmission runs are
+ *        merged and sent with the next one.
+ *
+ *        HAL shall:
+ *          - Start transmission of the given bytes without waiting for it in
+ *            hal_send_to_host_start()
+ *          - Call tx_queue_isr_done() from transmission complete interrupt
+ *
+ * @note  Queue shall be flushed before anything that stops the transmission:
+ *        restart, jump to user application, change of baud rate.
+ */
+#ifndef CBL_TX_QUEUE_H
+#define CBL_TX_QUEUE_H
+#include "cbl_common.h"
+#include "cbl_wait.h"
+
+#define TX_QUEUE_SZ 2048u /*!< Size of the queue, shall be power of 2 */
+
+#ifndef CBL_TX_TIMEOUT_MS
+#define CBL_TX_TIMEOUT_MS 5000u /*!< Waiting for the queue to drain */
+#endif
+
+cbl_err_code_t tx_queue_send (const char * buf, size_t len);
+cbl_err_code_t tx_queue_flush (void);
+void tx_queue_isr_done (void);
+
+#endif /* CBL_TX_QUEUE_H */
+/*** end of file ***/
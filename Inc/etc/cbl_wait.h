@@ -0,0 +1,34 @@
+/** @file cbl_wait.h
+ *
+ * @brief Waiting for completion flags raised from interrupts. Core sleeps
+ *        between checks instead of spinning.
+ *
+ *        HAL shall provide:
+ *          - hal_tick_get() - milliseconds since start, may wrap
+ *          - hal_wait_for_event() - sleeps until the next interrupt (WFE with
+ *            SEVONPEND, or WFI). Must not lose an interrupt that happened
+ *            since the last check, SysTick wakes it at the latest.
+ */
+#ifndef CBL_WAIT_H
+#define CBL_WAIT_H
+#include "cbl_common.h"
+
+#define WAIT_FOREVER 0xFFFFFFFFu /*!< Timeout that never expires */
+
+#ifndef CBL_CMD_TIMEOUT_MS
+#define CBL_CMD_TIMEOUT_MS WAIT_FOREVER /*!< Waiting for a shell command */
+#endif
+
+#ifndef CBL_RX_TIMEOUT_MS
+#define CBL_RX_TIMEOUT_MS 5000u /*!< Waiting for data in the middle of a
+                                     transfer */
+#endif
+
+/** Returns true when the awaited event happened */
+typedef bool (*wait_cond_t) (uint32_t arg);
+
+cbl_err_code_t wait_until (wait_cond_t cond, uint32_t arg,
+        uint32_t timeout_ms);
+
+#endif /* CBL_WAIT_H */
+/*** end of file ***/
@@ -0,0 +1,385 @@
+/** @file cbl_cmds_binary.c
+ *
+ * @brief Binary framed protocol for automated flashing. Shell switches to it
+ *        when the host sends TXT_CMD_BINARY, frames are described in
+ *        cbl_frame.h
+ */
+#include "commands/cbl_cmds_binary.h"
+#include "etc/cbl_frame.h"
+#include "etc/cbl_tx_queue.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#if 1 == USE_CMDS_UPDATE_NEW
+#include "commands/cbl_cmds_update_new.h"
+#endif
+
+static cbl_err_code_t bin_handle_op (frame_t * p_frame, bool * p_isTextReq);
+static cbl_err_code_t bin_flash_write (frame_t * p_frame);
+static cbl_err_code_t bin_mem_read (frame_t * p_frame);
+static cbl_err_code_t bin_jump_to (frame_t * p_frame);
+#ifdef CBL_CMDS_UPDATE_NEW_H
+static cbl_err_code_t bin_update_new_start (frame_t * p_frame);
+static cbl_err_code_t bin_update_new_end (frame_t * p_frame);
+#endif
+
+/**
+ * @brief Runs the binary protocol until the host requests the text shell or
+ *        exit. Every received frame is answered with a response frame.
+ */
+cbl_err_code_t cmd_binary (parser_t * phPrsr)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    bool isTextReq = false;
+    uint8_t version = BIN_PROTOCOL_VERSION;
+
+    DEBUG("Started\r\n");
+
+    /* Confirm the switch to the host */
+    eCode = frame_send(BIN_OP_PING, CBL_ERR_OK, &version, sizeof(version));
+    ERR_CHECK(eCode);
+
+    while (false == isTextReq && false == gIsExitReq)
+    {
+        frame_t frame;
+
+        eCode = frame_recv( &frame);
+        if (CBL_ERR_FRAME_LEN == eCode || CBL_ERR_FRAME_CRC == eCode
+                || CBL_ERR_RX_TIMEOUT == eCode)
+        {
+            /* Notify the host to send the frame again */
+            eCode = frame_send(frame.opcode, eCode, NULL, 0);
+            ERR_CHECK(eCode);
+            continue;
+        }
+        ERR_CHECK(eCode);
+
+        hal_led_on(LED_BUSY);
+        eCode = bin_handle_op( &frame, &isTextReq);
+        hal_led_off(LED_BUSY);
+        ERR_CHECK(eCode);
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Executes operation from the frame and responds to the host
+ *
+ * @param p_frame[in]      Received frame
+ * @param p_isTextReq[out] Set to true when host requests the text shell
+ *
+ * @return Error only if response couldn't be sent
+ */
+static cbl_err_code_t bin_handle_op (frame_t * p_frame, bool * p_isTextReq)
+{
+    cbl_err_code_t status = CBL_ERR_OK;
+    const uint8_t *p_data = NULL;
+    uint32_t data_len = 0;
+    uint8_t resp[32] = { 0 };
+
+    switch (p_frame->opcode)
+    {
+        case BIN_OP_PING:
+        {
+            resp[0] = BIN_PROTOCOL_VERSION;
+            p_data = resp;
+            data_len = 1;
+        }
+        break;
+
+        case BIN_OP_VERSION:
+        {
+            p_data = (const uint8_t *)CBL_VERSION;
+            data_len = strlen(CBL_VERSION);
+        }
+        break;
+
+        case BIN_OP_CID:
+        {
+            frame_put_ui32(resp, hal_id_code_get());
+            p_data = resp;
+            data_len = 4;
+        }
+        break;
+
+        case BIN_OP_GET_RDP_LVL:
+        {
+            hal_rdp_lvl_get((char *)resp, sizeof(resp));
+            p_data = resp;
+            data_len = strlen((char *)resp);
+        }
+        break;
+
+        case BIN_OP_GET_WRITE_PROT:
+        {
+            status = hal_write_prot_get((char *)resp, sizeof(resp));
+            p_data = resp;
+            data_len = strlen((char *)resp);
+        }
+        break;
+
+        case BIN_OP_CHANGE_WRITE_PROT:
+        {
+            if (p_frame->len != 5)
+            {
+                status = CBL_ERR_NEED_PARAM;
+            }
+            else
+            {
+                status = hal_change_write_prot(
+                        frame_get_ui32(p_frame->p_body),
+                        p_frame->p_body[4] != 0);
+            }
+        }
+        break;
+
+        case BIN_OP_FLASH_ERASE:
+        {
+            if (p_frame->len != 2)
+            {
+                status = CBL_ERR_NEED_PARAM;
+            }
+            else
+            {
+                status = hal_flash_erase_sector(p_frame->p_body[0],
+                        p_frame->p_body[1]);
+            }
+        }
+        break;
+
+        case BIN_OP_FLASH_ERASE_MASS:
+        {
+            status = hal_flash_erase_mass();
+        }
+        break;
+
+        case BIN_OP_FLASH_WRITE:
+        {
+            status = bin_flash_write(p_frame);
+        }
+        break;
+
+        case BIN_OP_MEM_READ:
+        {
+            /* Responds with requested bytes on its own */
+            return bin_mem_read(p_frame);
+        }
+        break;
+
+        case BIN_OP_JUMP_TO:
+        {
+            /* Responds on its own, returns only on error */
+            return bin_jump_to(p_frame);
+        }
+        break;
+
+#ifdef CBL_CMDS_UPDATE_NEW_H
+        case BIN_OP_UPDATE_NEW_START:
+        {
+            status = bin_update_new_start(p_frame);
+        }
+        break;
+
+        case BIN_OP_UPDATE_NEW_END:
+        {
+            /* Responds on its own, returns only on error */
+            return bin_update_new_end(p_frame);
+        }
+        break;
+#endif /* CBL_CMDS_UPDATE_NEW_H */
+
+        case BIN_OP_RESET:
+        {
+            status = frame_send(p_frame->opcode, CBL_ERR_OK, NULL, 0);
+            tx_queue_flush();
+
+            hal_system_restart();
+
+            /* Never returns */
+            return status;
+        }
+        break;
+
+        case BIN_OP_EXIT:
+        {
+            gIsExitReq = true;
+        }
+        break;
+
+        case BIN_OP_TEXT:
+        {
+            *p_isTextReq = true;
+        }
+        break;
+
+        default:
+        {
+            status = CBL_ERR_FRAME_OP;
+        }
+        break;
+    }
+
+    return frame_send(p_frame->opcode, status, p_data, data_len);
+}
+
+/**
+ * @brief Writes data from the frame to flash. Sector shall be erased prior.
+ *        Frame body: address (4), data
+ */
+static cbl_err_code_t bin_flash_write (frame_t * p_frame)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t addr;
+    uint32_t len;
+
+    if (p_frame->len <= 4)
+    {
+        return CBL_ERR_NEED_PARAM;
+    }
+
+    addr = frame_get_ui32(p_frame->p_body);
+    len = p_frame->len - 4u;
+
+    eCode = hal_verify_flash_address(addr);
+    ERR_CHECK(eCode);
+
+    eCode = hal_verify_flash_address(addr + len - 1);
+    ERR_CHECK(eCode);
+
+    hal_led_on(LED_MEMORY);
+    eCode = hal_write_program_bytes(addr, &p_frame->p_body[4], len);
+    hal_led_off(LED_MEMORY);
+
+    return eCode;
+}
+
+/**
+ * @brief Responds with bytes from memory.
+ *        Frame body: address (4), count (2)
+ */
+static cbl_err_code_t bin_mem_read (frame_t * p_frame)
+{
+    uint32_t addr;
+    uint32_t len;
+
+    if (p_frame->len != 6)
+    {
+        return frame_send(p_frame->opcode, CBL_ERR_NEED_PARAM, NULL, 0);
+    }
+
+    addr = frame_get_ui32(p_frame->p_body);
+    len = frame_get_ui16( &p_frame->p_body[4]);
+
+    if (len > FRAME_MAX_DATA)
+    {
+        return frame_send(p_frame->opcode, CBL_ERR_INV_SZ, NULL, 0);
+    }
+
+    return frame_send(p_frame->opcode, CBL_ERR_OK, (uint8_t *)addr, len);
+}
+
+/**
+ * @brief Responds and jumps to a requested address.
+ *        Frame body: address (4)
+ */
+static cbl_err_code_t bin_jump_to (frame_t * p_frame)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t addr;
+    void (*jump) (void);
+
+    if (p_frame->len != 4)
+    {
+        return frame_send(p_frame->opcode, CBL_ERR_NEED_PARAM, NULL, 0);
+    }
+
+    addr = frame_get_ui32(p_frame->p_body);
+
+    eCode = hal_verify_jump_address(addr);
+    if (eCode != CBL_ERR_OK)
+    {
+        return frame_send(p_frame->opcode, eCode, NULL, 0);
+    }
+
+    eCode = frame_send(p_frame->opcode, CBL_ERR_OK, NULL, 0);
+    ERR_CHECK(eCode);
+
+    /* Set the T bit, as in cmd_jump_to */
+    jump = (void *)(addr + 1);
+
+    eCode = tx_queue_flush();
+    ERR_CHECK(eCode);
+
+    jump();
+    return eCode;
+}
+
+#ifdef CBL_CMDS_UPDATE_NEW_H
+/**
+ * @brief Erases sectors of new application area the new application will
+ *        take. New application is then written with BIN_OP_FLASH_WRITE
+ *        starting from its start, with CBL_AB_SLOTS from the start of the
+ *        slot application isn't started from.
+ *        Frame body: length (4)
+ */
+static cbl_err_code_t bin_update_new_start (frame_t * p_frame)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    if (p_frame->len != 4)
+    {
+        return CBL_ERR_NEED_PARAM;
+    }
+
+    eCode = update_new_check(frame_get_ui32(p_frame->p_body), TYPE_BIN);
+    ERR_CHECK(eCode);
+
+    return update_new_erase(frame_get_ui32(p_frame->p_body));
+}
+
+/**
+ * @brief Marks written new application as ready, responds and restarts.
+ *        Frame body: length (4), app_type_t (1)
+ *
+ * @note  Data is protected by CRC of every frame, so no checksum is recorded
+ */
+static cbl_err_code_t bin_update_new_end (frame_t * p_frame)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t len;
+    app_type_t app_type;
+
+    if (p_frame->len != 5)
+    {
+        return frame_send(p_frame->opcode, CBL_ERR_NEED_PARAM, NULL, 0);
+    }
+
+    len = frame_get_ui32(p_frame->p_body);
+    app_type = (app_type_t)p_frame->p_body[4];
+
+    eCode = update_new_check(len, app_type);
+    if (CBL_ERR_OK == eCode)
+    {
+        eCode = update_new_set_ready(len, CKSUM_NO, app_type);
+    }
+
+    if (eCode != CBL_ERR_OK)
+    {
+        return frame_send(p_frame->opcode, eCode, NULL, 0);
+    }
+
+    eCode = frame_send(p_frame->opcode, CBL_ERR_OK, NULL, 0);
+    ERR_CHECK(eCode);
+
+    INFO("Restarting...\r\n");
+    tx_queue_flush();
+    hal_system_restart();
+
+    /* NEVER REACHED */
+    return eCode;
+}
+#endif /* CBL_CMDS_UPDATE_NEW_H */
+
+/*** end of file ***/
@@ -4,11 +4,16 @@
  *        own file
  */
 #include "commands/cbl_cmds_etc.h"
+#include "etc/cbl_rx_ring.h"
+#include "etc/cbl_tx_queue.h"
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+static cbl_err_code_t enum_param_flow (char * char_flow, uint32_t len,
+        bool * p_isFlowCtrl);
+
 /**
  * @brief Returns chip ID to the host
  */
@@ -31,7 +36,7 @@ cbl_err_code_t cmd_cid (parser_t * phPrsr)
     strlcat(cid, CRLF, 12);
 
     /* Send response */
-    eCode = hal_send_to_host(cid, strlen(cid));
+    eCode = tx_queue_send(cid, strlen(cid));
 
     return eCode;
 }
@@ -50,4 +55,115 @@ cbl_err_code_t cmd_exit (parser_t * phPrsr)
     return eCode;
 }
 
+/**
+ * @brief Switches UART to a new baud rate. "OK" is sent at the old rate, then
+ *        the host switches too and sends TXT_SET_BAUD_CONFIRM at the new
+ *        rate, which is answered with "OK". If it doesn't arrive within
+ *        CBL_BAUD_CONFIRM_MS the old rate is restored, so the host can't be
+ *        locked out.
+ *        Parameters needed from phPrsr:
+ *          - rate - New baud rate
+ *          - flow - Optional, "rts-cts" for hardware flow control
+ */
+cbl_err_code_t cmd_set_baud (parser_t * phPrsr)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    char *charRate = NULL;
+    char *charFlow = NULL;
+    uint32_t rate;
+    bool isFlowCtrl = false;
+    uint32_t old_rate = hal_baud_get();
+    bool old_isFlowCtrl = hal_flow_ctrl_get();
+    char confirm[] = TXT_SET_BAUD_CONFIRM;
+
+    DEBUG("Started\r\n");
+
+    charRate = parser_get_val(phPrsr, TXT_PAR_SET_BAUD_RATE,
+            strlen(TXT_PAR_SET_BAUD_RATE));
+    if (NULL == charRate)
+    {
+        return CBL_ERR_NEED_PARAM;
+    }
+
+    eCode = str2ui32(charRate, strlen(charRate), &rate, 10);
+    ERR_CHECK(eCode);
+
+    /* Check if flow parameter is given */
+    charFlow = parser_get_val(phPrsr, TXT_PAR_SET_BAUD_FLOW,
+            strlen(TXT_PAR_SET_BAUD_FLOW));
+    if (charFlow != NULL)
+    {
+        eCode = enum_param_flow(charFlow, strlen(charFlow), &isFlowCtrl);
+        ERR_CHECK(eCode);
+    }
+
+    eCode = hal_baud_check(rate, isFlowCtrl);
+    ERR_CHECK(eCode);
+
+    /* Acknowledge at the old rate, it shall be sent before switching */
+    eCode = tx_queue_send(TXT_SUCCESS, strlen(TXT_SUCCESS));
+    ERR_CHECK(eCode);
+
+    eCode = tx_queue_flush();
+    ERR_CHECK(eCode);
+
+    eCode = hal_baud_set(rate, isFlowCtrl);
+    ERR_CHECK(eCode);
+
+    /* Drop everything received while switching, it is garbage */
+    rx_ring_flush();
+
+    eCode = rx_ring_recv((uint8_t *)confirm, strlen(TXT_SET_BAUD_CONFIRM),
+            CBL_BAUD_CONFIRM_MS);
+    if (CBL_ERR_OK == eCode
+            && strncmp(confirm, TXT_SET_BAUD_CONFIRM,
+                    strlen(TXT_SET_BAUD_CONFIRM)) != 0)
+    {
+        eCode = CBL_ERR_BAUD_CONFIRM;
+    }
+
+    if (eCode != CBL_ERR_OK)
+    {
+        /* Host didn't follow, fall back to the rate it still listens on */
+        tx_queue_flush();
+        hal_baud_set(old_rate, old_isFlowCtrl);
+        rx_ring_flush();
+
+        return CBL_ERR_BAUD_CONFIRM;
+    }
+
+    /* Shell confirms with "OK" at the new rate */
+    return eCode;
+}
+
+/**
+ * @brief Converts text of flow parameter to boolean
+ *
+ * @param char_flow    Text of flow parameter value
+ * @param len          Length of char_flow
+ * @param p_isFlowCtrl Set to true if hardware flow control is requested
+ */
+static cbl_err_code_t enum_param_flow (char * char_flow, uint32_t len,
+        bool * p_isFlowCtrl)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    if (strlen(TXT_PAR_SET_BAUD_FLOW_HW) == len
+            && strncmp(char_flow, TXT_PAR_SET_BAUD_FLOW_HW, len) == 0)
+    {
+        ( *p_isFlowCtrl) = true;
+    }
+    else if (strlen(TXT_PAR_SET_BAUD_FLOW_NO) == len
+            && strncmp(char_flow, TXT_PAR_SET_BAUD_FLOW_NO, len) == 0)
+    {
+        ( *p_isFlowCtrl) = false;
+    }
+    else
+    {
+        eCode = CBL_ERR_INV_PARAM;
+    }
+
+    return eCode;
+}
+
 /*** end of file ***/
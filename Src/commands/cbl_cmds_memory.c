@@ -3,10 +3,96 @@
  * @brief Contains functions for memory access from the bootloader
  */
 #include "commands/cbl_cmds_memory.h"
+#include "etc/cbl_rx_ring.h"
+#include "etc/cbl_tx_queue.h"
+#include "etc/cbl_lz4.h"
+#include "etc/cbl_journal.h"
+#include "etc/cbl_flash.h"
+#include "etc/cbl_frame.h"
 #include "string.h"
 
+#if RX_RING_SZ < (FLASH_WRITE_MAX_WINDOW * (FLASH_WRITE_SEQ_SZ + FLASH_WRITE_SZ))
+#error "RX ring can't hold the whole window of default chunks"
+#endif
+
+#if RX_RING_SZ < FLASH_WRITE_MAX_SZ
+#error "RX ring can't hold the largest chunk"
+#endif
+
+/** Staging pool, chunk being written to flash. Next one is received into RX
+ *  ring meanwhile */
+static uint8_t write_buf[FLASH_WRITE_SEQ_SZ + FLASH_WRITE_MAX_SZ];
+/** Decompresses chunks when compressed transfer is used */
+static lz4_dec_t write_lz4;
+
+/** Run of sparse transfer, bytes outside of runs are erased (0xFF) */
+typedef struct
+{
+    uint32_t offset; /*!< Offset from the start of the transfer */
+    uint32_t len; /*!< Number of bytes in the run */
+} write_run_t;
+
+/** Run table of sparse transfer */
+static write_run_t write_runs[FLASH_WRITE_MAX_RUNS];
+
+/** State of one flash_write transfer */
+typedef struct
+{
+    cksum_t cksum; /*!< Checksum of written bytes */
+    cksum_ctx_t h_cksum; /*!< State of the checksum */
+    lz4_dec_t *p_lz4; /*!< Decompresses received chunks, NULL if not
+                           compressed */
+    bool is_journal; /*!< Progress is recorded to the journal */
+    uint32_t done; /*!< Bytes written, recorded to the journal */
+    uint32_t start; /*!< Starting address, used by sparse transfer */
+    uint32_t n_runs; /*!< Runs in write_runs, 0 if not sparse */
+    uint32_t run; /*!< Run being received */
+    uint32_t run_done; /*!< Bytes of the run received */
+    uint32_t img_pos; /*!< Offset of the next byte in the whole image */
+    bool is_diff; /*!< Bytes already in flash are not programmed */
+    uint32_t skipped; /*!< Bytes not programmed because they matched */
+    bool is_erase_auto; /*!< Sectors are erased as bytes land in them */
+    uint32_t erased_end; /*!< Flash before this address is erased or was
+     written by the transfer */
+} write_ctx_t;
+
+static cbl_err_code_t write_chunks_handshake (uint32_t start, uint32_t len,
+        uint32_t chunk_sz, uint32_t n_chunks, write_ctx_t * p_ctx);
+static cbl_err_code_t write_chunks_windowed (uint32_t start, uint32_t len,
+        uint32_t chunk_sz, uint32_t n_chunks, uint32_t window,
+        write_ctx_t * p_ctx);
+static cbl_err_code_t write_chunk (write_ctx_t * p_ctx, uint32_t chunk_addr,
+        uint8_t * p_chunk, uint32_t chunk_len);
+static cbl_err_code_t write_program (uint32_t addr, uint8_t * buf,
+        uint32_t len, void * p_ctx);
+static cbl_err_code_t write_get_runs (uint32_t len, write_ctx_t * p_ctx,
+        uint32_t * p_xfer_len);
+static cbl_err_code_t write_sparse (write_ctx_t * p_ctx, uint8_t * p_chunk,
+        uint32_t chunk_len);
+static cbl_err_code_t write_gap (write_ctx_t * p_ctx, uint32_t offset);
+static cbl_err_code_t write_erase (write_ctx_t * p_ctx, uint32_t end);
+static cbl_err_code_t write_get_compress (parser_t * ph_prsr,
+        flash_write_opt_t * p_opt);
+static cbl_err_code_t write_get_diff (parser_t * ph_prsr,
+        flash_write_opt_t * p_opt);
+static cbl_err_code_t write_get_erase (parser_t * ph_prsr,
+        flash_write_opt_t * p_opt);
+static uint32_t write_chunk_len (uint32_t len, uint32_t chunk_sz,
+        uint32_t chunk_num);
+static cbl_err_code_t write_request_chunk (uint32_t chunk_num,
+        uint32_t chunk_len, uint32_t chunk_addr);
 static cbl_err_code_t write_get_params (parser_t * ph_prsr, uint32_t * p_start,
         uint32_t * p_len, cksum_t * cksum);
+static cbl_err_code_t read_stream (uint32_t start, uint32_t len,
+        uint32_t frame_sz);
+static cbl_err_code_t read_frames (uint32_t start, uint32_t len,
+        uint32_t frame_sz, uint32_t offset, bool is_merge, uint32_t * p_next);
+static cbl_err_code_t read_send (mem_read_type_t type, uint32_t offset,
+        uint32_t len, const uint8_t * p_payload, uint32_t payload_len);
+static bool read_is_run (const uint8_t * buf, uint32_t len, uint8_t fill);
+static cbl_err_code_t hash_get_params (parser_t * ph_prsr, uint32_t * p_start,
+        uint32_t * p_len, cksum_t * p_cksum);
+static cbl_err_code_t hash_send (uint32_t start, uint32_t len, cksum_t cksum);
 
 /**
  * @brief   Jumps to a requested address.
@@ -47,7 +133,10 @@ cbl_err_code_t cmd_jump_to (parser_t * phPrsr)
     jump = (void *)addr;
 
     /* Send response */
-    eCode = hal_send_to_host(TXT_SUCCESS, strlen(TXT_SUCCESS));
+    eCode = tx_queue_send(TXT_SUCCESS, strlen(TXT_SUCCESS));
+    ERR_CHECK(eCode);
+
+    eCode = tx_queue_flush();
     ERR_CHECK(eCode);
 
     /* Jump to requested address, user ensures requested address is valid */
@@ -60,19 +149,25 @@ cbl_err_code_t cmd_jump_to (parser_t * phPrsr)
  * @brief   Erases flash memory according to parameters.
  *          Parameters needed from phPrsr:
  *              - type - Defines type of flash erase. "mass" erases all sectors,
- *               "sector" erases only selected sectors
+ *               "sector" erases only selected sectors, "range" erases sectors
+ *               the range of addresses overlaps
  *              - sector - First sector to erase. Bootloader is on sectors 0, 1
- *               and 2. Not needed with mass erase
- *              - count - Number of sectors to erase. Not needed with mass erase
+ *               and 2. Only with sector erase
+ *              - start - First address of the range in hex format. Only with
+ *               range erase
+ *              - count - Number of sectors to erase, with range erase number
+ *               of bytes. Not needed with mass erase
  */
 cbl_err_code_t cmd_flash_erase (parser_t * phPrsr)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
     char *charSect = NULL;
     char *charCount = NULL;
+    char *charStart = NULL;
     char *type = NULL;
     uint32_t sect;
     uint32_t count;
+    uint32_t start;
 
     DEBUG("Started\r\n");
 
@@ -116,6 +211,29 @@ cbl_err_code_t cmd_flash_erase (parser_t * phPrsr)
         eCode = hal_flash_erase_sector(sect, count);
         ERR_CHECK(eCode);
     }
+    else if (strncmp(type, TXT_PAR_FLASH_ERASE_TYPE_RANGE,
+            strlen(TXT_PAR_FLASH_ERASE_TYPE_RANGE)) == 0)
+    {
+        charStart = parser_get_val(phPrsr, TXT_PAR_FLASH_ERASE_START,
+                strlen(TXT_PAR_FLASH_ERASE_START));
+        charCount = parser_get_val(phPrsr, TXT_PAR_FLASH_ERASE_COUNT,
+                strlen(TXT_PAR_FLASH_ERASE_COUNT));
+        if (NULL == charStart || NULL == charCount)
+        {
+            return CBL_ERR_NEED_PARAM;
+        }
+
+        /* Fill start, skips 0x if present */
+        eCode = str2ui32(charStart, strlen(charStart), &start, 16);
+        ERR_CHECK(eCode);
+
+        eCode = str2ui32(charCount, strlen(charCount), &count, 10);
+        ERR_CHECK(eCode);
+
+        /* Only sectors the range overlaps */
+        eCode = flash_erase(start, count);
+        ERR_CHECK(eCode);
+    }
     else if (strncmp(type, TXT_PAR_FLASH_ERASE_TYPE_MASS,
             strlen(TXT_PAR_FLASH_ERASE_TYPE_MASS)) == 0)
     {
@@ -137,8 +255,14 @@ cbl_err_code_t cmd_flash_erase (parser_t * phPrsr)
  *             - start - Starting address in hex format (e.g. 0x12345678),
  *               0x can be omitted
  *             - count - Number of bytes to write without checksum.
- *                       Maximum bytes: FLASH_WRITE_SZ
  *             - cksum - Checksum to use
+ *             - window - Optional, number of chunks host streams ahead
+ *             - chunk - Optional, chunk size, maximum FLASH_WRITE_MAX_SZ
+ *             - compress - Optional, compression of sent bytes
+ *             - zcount - Number of compressed bytes, needed with compress
+ *             - runs - Optional, number of runs of sparse transfer
+ *             - diff - Optional, bytes already in flash are not programmed
+ *             - erase - Optional, "auto" erases sectors as chunks land in them
  *
  * @note    If using checksum, data will be written to memory before checking
  *          for checksum!
@@ -149,13 +273,17 @@ cbl_err_code_t cmd_flash_write (parser_t * phPrsr)
     uint32_t start;
     uint32_t len;
     cksum_t cksum = CKSUM_UNDEF;
+    flash_write_opt_t opt;
 
     DEBUG("Started\r\n");
 
     eCode = write_get_params(phPrsr, &start, &len, &cksum);
     ERR_CHECK(eCode);
 
-    eCode = flash_write(start, len, cksum);
+    eCode = flash_write_get_opts(phPrsr, &opt);
+    ERR_CHECK(eCode);
+
+    eCode = flash_write(start, len, cksum, &opt);
 
     return eCode;
 }
@@ -167,14 +295,17 @@ cbl_err_code_t cmd_flash_write (parser_t * phPrsr)
  *             - start - Starting address in hex format (e.g. 0x12345678),
  *              0x can be omitted
  *             - count - Number of bytes to read
+ *             - [frame] - Frame size, bytes are streamed in frames if present
  */
 cbl_err_code_t cmd_mem_read (parser_t * phPrsr)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
     char *charStart = NULL;
     char *charLen = NULL;
+    char *charFrame = NULL;
     uint32_t start;
     uint32_t len;
+    uint32_t frame_sz;
 
     DEBUG("Started\r\n");
 
@@ -200,94 +331,266 @@ cbl_err_code_t cmd_mem_read (parser_t * phPrsr)
     eCode = str2ui32(charLen, strlen(charLen), &len, 10);
     ERR_CHECK(eCode);
 
-    /* Send requested bytes */
-    eCode = hal_send_to_host((char *)start, len);
+    /* Get frame size, optional parameter */
+    charFrame = parser_get_val(phPrsr, TXT_PAR_MEM_READ_FRAME,
+            strlen(TXT_PAR_MEM_READ_FRAME));
+    if (NULL == charFrame)
+    {
+        /* Send requested bytes */
+        eCode = tx_queue_send((char *)start, len);
+        return eCode;
+    }
+
+    eCode = str2ui32(charFrame, strlen(charFrame), &frame_sz, 10);
+    ERR_CHECK(eCode);
+
+    if (0 == frame_sz || frame_sz > MEM_READ_MAX_FRAME)
+    {
+        return CBL_ERR_READ_FRAME;
+    }
+
+    return read_stream(start, len, frame_sz);
+}
+
+/**
+ * @brief   Calculates checksum of memory and sends only it, as lowercase hex
+ *          in the byte order host sends checksums with
+ *          Parameters needed from phPrsr:
+ *             - start - Starting address in hex format (e.g. 0x12345678),
+ *              0x can be omitted
+ *             - count - Number of bytes to hash
+ *             - algo - Checksum to calculate, crc32 or sha256
+ */
+cbl_err_code_t cmd_mem_hash (parser_t * phPrsr)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t start;
+    uint32_t len;
+    cksum_t cksum = CKSUM_UNDEF;
+
+    DEBUG("Started\r\n");
+
+    eCode = hash_get_params(phPrsr, &start, &len, &cksum);
+    ERR_CHECK(eCode);
+
+    if (CKSUM_UNDEF == cksum)
+    {
+        return CBL_ERR_NEED_PARAM;
+    }
+
+    if (len % checksum_get_multiple(cksum) != 0)
+    {
+        return CBL_ERR_HASH_LEN;
+    }
+
+    return hash_send(start, len, cksum);
+}
+
+/**
+ * @brief   Sends checksums of consecutive blocks of memory, one per line,
+ *          after "blocks:<number of blocks>". Host compares them with its
+ *          image and writes only the blocks that differ.
+ *          Parameters needed from phPrsr:
+ *             - start - Starting address in hex format (e.g. 0x12345678),
+ *              0x can be omitted
+ *             - count - Number of bytes covered by the map
+ *             - [block] - Block size, last block may be shorter
+ *             - [algo] - Checksum of blocks, crc32 if not present
+ */
+cbl_err_code_t cmd_mem_map (parser_t * phPrsr)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    char *charBlock = NULL;
+    uint32_t start;
+    uint32_t len;
+    uint32_t block_sz = MEM_MAP_BLOCK_SZ;
+    uint32_t n_blocks;
+    cksum_t cksum = CKSUM_CRC32;
+    char blocks_info[32] = { 0 };
+
+    DEBUG("Started\r\n");
+
+    eCode = hash_get_params(phPrsr, &start, &len, &cksum);
+    ERR_CHECK(eCode);
+
+    /* Get block size, optional parameter */
+    charBlock = parser_get_val(phPrsr, TXT_PAR_MEM_MAP_BLOCK,
+            strlen(TXT_PAR_MEM_MAP_BLOCK));
+    if (charBlock != NULL)
+    {
+        eCode = str2ui32(charBlock, strlen(charBlock), &block_sz, 10);
+        ERR_CHECK(eCode);
+    }
+
+    /* Every block is checksummed on its own */
+    if (0 == block_sz || block_sz % checksum_get_multiple(cksum) != 0)
+    {
+        return CBL_ERR_MAP_BLOCK;
+    }
+
+    if (len % checksum_get_multiple(cksum) != 0)
+    {
+        return CBL_ERR_HASH_LEN;
+    }
+
+    n_blocks = (len + block_sz - 1) / block_sz;
+
+    snprintf(blocks_info, sizeof(blocks_info), "\r\nblocks:%lu\r\n",
+            n_blocks);
+    eCode = tx_queue_send(blocks_info, strlen(blocks_info));
+    ERR_CHECK(eCode);
+
+    for (uint32_t offset = 0; offset < len; offset += block_sz)
+    {
+        eCode = hash_send(start + offset,
+                (len - offset < block_sz) ? len - offset : block_sz, cksum);
+        ERR_CHECK(eCode);
+    }
+
     return eCode;
 }
 
 /**
- * @brief  Writes to flash, sector to be written into shall be erased prior
+ * @brief  Writes to flash, sector to be written into shall be erased prior.
+ *         Chunks are received with the text handshake, or streamed by the
+ *         host 'window' chunks ahead if p_opt->window is not 0. Chunk size
+ *         is chosen by the host up to FLASH_WRITE_MAX_SZ. Compressed chunks
+ *         are decompressed on the fly, checksum is of decompressed bytes.
+ *         Interrupted transfer continues after p_opt->done bytes, which are
+ *         read back from flash into the checksum. Sparse transfer sends only
+ *         runs from the run table, checksum is of the whole image with erased
+ *         bytes (0xFF) between them. Differential transfer compares flash
+ *         with the data and programs only bytes that differ. With automatic
+ *         erase a sector is erased the first time bytes land in it, so
+ *         erasing takes time proportional to the image and the first chunk
+ *         is requested at once. Sector 'start' is in is erased only if
+ *         'start' is its first byte, bytes in front of it are kept.
  *
  * @param start Starting address
- * @param len   Number of bytes to write without checksum.
+ * @param len   Number of bytes to write without checksum, decompressed
  * @param cksum Checksum to use
+ * @param p_opt Transfer options, NULL for default
  *
  * @note    If using checksum, data will be written to memory before checking
  *          for checksum!
  */
-cbl_err_code_t flash_write (uint32_t start, uint32_t len, cksum_t cksum)
+cbl_err_code_t flash_write (uint32_t start, uint32_t len, cksum_t cksum,
+        const flash_write_opt_t * p_opt)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
-    uint8_t write_buf[FLASH_WRITE_SZ] = { 0 };
     uint32_t n_chunks;
-    uint32_t iii = 0;
-    uint32_t left_to_write;
-    uint32_t chunk_addr;
-    char chunk_succ[] = "\r\nchunk OK\r\n";
-    SHA256_CTX h_cksum_sha256 = { 0 };
+    write_ctx_t ctx = { 0 };
     char chunk_info[64] = { 0 };
     uint32_t cksum_len = 0;
+    uint32_t window = 0;
+    uint32_t chunk_sz = FLASH_WRITE_SZ;
+    uint32_t xfer_len = len; /* Number of bytes sent by the host */
 
-    /* Get number of chunks */
-    n_chunks = len / FLASH_WRITE_SZ;
-    n_chunks = len % FLASH_WRITE_SZ ? n_chunks + 1 : n_chunks;
+    if (p_opt != NULL)
+    {
+        window = p_opt->window;
+        chunk_sz = p_opt->chunk_sz;
+        ctx.is_journal = p_opt->is_journal;
+        ctx.done = p_opt->done;
+        ctx.n_runs = p_opt->runs;
+        ctx.is_diff = p_opt->is_diff;
+        ctx.is_erase_auto = (ERASE_AUTO == p_opt->erase);
 
-    /* Notify host how many chunks are expected */
-    snprintf(chunk_info, sizeof(chunk_info), "\r\nchunks:%lu\r\n", n_chunks);
-    eCode = hal_send_to_host(chunk_info, strlen(chunk_info));
-    ERR_CHECK(eCode);
+        if (ctx.is_diff && ctx.is_erase_auto)
+        {
+            /* Erased sector would lose bytes that matched */
+            return CBL_ERR_PAR_ERASE;
+        }
 
-    left_to_write = len;
-    chunk_addr = start;
+        if (COMPRESS_LZ4 == p_opt->compress)
+        {
+            xfer_len = p_opt->zlen;
+            ctx.p_lz4 = &write_lz4;
+            lz4_init(ctx.p_lz4, start, len, write_program, &ctx);
+        }
+    }
 
-    /* Second parameter is used only when sha256 is used */
-    init_checksum(cksum, &h_cksum_sha256);
+    ctx.cksum = cksum;
+    init_checksum(cksum, &ctx.h_cksum);
 
-    /* Get chunks one by one from host, and write them to memory, accumulating
-     * checksum */
-    while (iii < n_chunks)
+    if (ctx.done != 0)
     {
-        uint32_t chunk_len = ui32_min(left_to_write, (uint32_t)FLASH_WRITE_SZ);
-
-        /* Notify host about current chunk number and length */
-        snprintf(chunk_info, sizeof(chunk_info),
-                "\r\nchunk:%lu|length:%lu|address:0x%08lx\r\n", iii, chunk_len,
-                chunk_addr);
-        eCode = hal_send_to_host(chunk_info, strlen(chunk_info));
+        /* Checksum continues from bytes written before */
+        eCode = accumulate_checksum((uint8_t *)start, ctx.done, cksum,
+                &ctx.h_cksum);
         ERR_CHECK(eCode);
 
-        /* Reset UART byte counter */
-        gRxCmdCntr = 0;
+        start += ctx.done;
+        xfer_len -= ctx.done;
+    }
 
-        /* Notify host to send the bytes */
-        eCode = hal_send_to_host(TXT_RESP_FLASH_WRITE_READY,
-                strlen(TXT_RESP_FLASH_WRITE_READY));
-        ERR_CHECK(eCode);
+    /* Sector the transfer starts or continues in the middle of is already
+     * erased, it holds bytes in front of 'start' */
+    ctx.erased_end = start;
+    if (ctx.is_erase_auto && flash_get_sector(start) != FLASH_NO_SECTOR
+            && flash_get_sector_info(flash_get_sector(start))->start != start)
+    {
+        ctx.erased_end = flash_get_sector_end(start);
+    }
+
+    if (ctx.n_runs != 0)
+    {
+        ctx.start = start;
 
-        /* Request 'chunk_len' bytes */
-        eCode = hal_recv_from_host_start(write_buf, chunk_len);
+        /* Only bytes of runs are sent */
+        eCode = write_get_runs(len, &ctx, &xfer_len);
         ERR_CHECK(eCode);
+    }
 
+    /* Get number of chunks */
+    n_chunks = xfer_len / chunk_sz;
+    n_chunks = xfer_len % chunk_sz ? n_chunks + 1 : n_chunks;
 
-        while (gRxCmdCntr != 1)
-        {
-            /* Wait for 'len' bytes */
-        }
+    /* Notify host how many chunks are expected */
+    snprintf(chunk_info, sizeof(chunk_info), "\r\nchunks:%lu\r\n", n_chunks);
+    eCode = tx_queue_send(chunk_info, strlen(chunk_info));
+    ERR_CHECK(eCode);
+
+    if (0 == window)
+    {
+        eCode = write_chunks_handshake(start, xfer_len, chunk_sz, n_chunks,
+                &ctx);
+    }
+    else
+    {
+        eCode = write_chunks_windowed(start, xfer_len, chunk_sz, n_chunks,
+                window, &ctx);
+    }
+    ERR_CHECK(eCode);
+
+    if (ctx.p_lz4 != NULL)
+    {
+        uint32_t decomp_len;
 
-        hal_led_on(LED_MEMORY);
-        eCode = hal_write_program_bytes(chunk_addr, write_buf, chunk_len);
-        hal_led_off(LED_MEMORY);
+        /* Write the rest of decompressed bytes */
+        eCode = lz4_finish(ctx.p_lz4, &decomp_len);
         ERR_CHECK(eCode);
 
-        /* NOTE: Last parameter is used only when sha256 is used */
-        accumulate_checksum(write_buf, chunk_len, cksum, &h_cksum_sha256);
+        if (decomp_len != len)
+        {
+            return CBL_ERR_DECOMP;
+        }
+    }
 
-        eCode = hal_send_to_host(chunk_succ, strlen(chunk_succ));
+    if (ctx.n_runs != 0)
+    {
+        /* Erased bytes after the last run */
+        eCode = write_gap( &ctx, len);
         ERR_CHECK(eCode);
+    }
 
-        chunk_addr += chunk_len;
-        left_to_write -= chunk_len;
-        iii++;
+    if (ctx.is_diff)
+    {
+        /* Notify host how many bytes already matched */
+        snprintf(chunk_info, sizeof(chunk_info), "\r\nskipped:%lu\r\n",
+                ctx.skipped);
+        eCode = tx_queue_send(chunk_info, strlen(chunk_info));
+        ERR_CHECK(eCode);
     }
 
     if (cksum != CKSUM_NO)
@@ -297,91 +600,1006 @@ cbl_err_code_t flash_write (uint32_t start, uint32_t len, cksum_t cksum)
         /* Notify host cksum is expected */
         snprintf(chunk_info, sizeof(chunk_info), "\r\nchecksum|length:%lu\r\n",
                 cksum_len);
-        eCode = hal_send_to_host(chunk_info, strlen(chunk_info));
+        eCode = tx_queue_send(chunk_info, strlen(chunk_info));
         ERR_CHECK(eCode);
 
-        /* Reset UART byte counter */
-        gRxCmdCntr = 0;
-
         /* Notify host to send the bytes */
-        eCode = hal_send_to_host(TXT_RESP_FLASH_WRITE_READY,
+        eCode = tx_queue_send(TXT_RESP_FLASH_WRITE_READY,
                 strlen(TXT_RESP_FLASH_WRITE_READY));
         ERR_CHECK(eCode);
 
-        /* Request 'chunk_len' bytes */
-        eCode = hal_recv_from_host_start(write_buf, cksum_len);
+        /* Wait for 'cksum_len' bytes */
+        eCode = rx_ring_recv(write_buf, cksum_len, CBL_RX_TIMEOUT_MS);
+        ERR_CHECK(eCode);
+
+        eCode = verify_checksum(write_buf, cksum_len, cksum, &ctx.h_cksum);
+        ERR_CHECK(eCode);
+    }
+    return eCode;
+}
+
+/**
+ * @brief Gets optional transfer parameters shared by all commands that use
+ *        flash_write
+ *
+ * @param ph_prsr[in] Parser containing parameters
+ * @param p_opt[out]  Transfer options
+ */
+cbl_err_code_t flash_write_get_opts (parser_t * ph_prsr,
+        flash_write_opt_t * p_opt)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    char *charWindow = NULL;
+    char *charChunk = NULL;
+    char *charRuns = NULL;
+
+    /* Options not given and fields set by the caller start from 0 */
+    memset(p_opt, 0, sizeof( *p_opt));
+    p_opt->chunk_sz = FLASH_WRITE_SZ;
+
+    /* Get chunk size, optional parameter */
+    charChunk = parser_get_val(ph_prsr, TXT_PAR_FLASH_WRITE_CHUNK,
+            strlen(TXT_PAR_FLASH_WRITE_CHUNK));
+    if (charChunk != NULL)
+    {
+        eCode = str2ui32(charChunk, strlen(charChunk), &p_opt->chunk_sz, 10);
+        ERR_CHECK(eCode);
+
+        if (0 == p_opt->chunk_sz || p_opt->chunk_sz > FLASH_WRITE_MAX_SZ
+                || p_opt->chunk_sz % 4 != 0)
+        {
+            return CBL_ERR_CHUNK_SZ;
+        }
+    }
+
+    /* Get window size, optional parameter */
+    charWindow = parser_get_val(ph_prsr, TXT_PAR_FLASH_WRITE_WINDOW,
+            strlen(TXT_PAR_FLASH_WRITE_WINDOW));
+    if (charWindow != NULL)
+    {
+        eCode = str2ui32(charWindow, strlen(charWindow), &p_opt->window, 10);
         ERR_CHECK(eCode);
 
-        while (gRxCmdCntr != 1)
+        if (0 == p_opt->window || p_opt->window > FLASH_WRITE_MAX_WINDOW)
+        {
+            return CBL_ERR_WINDOW;
+        }
+
+        /* Chunks sent ahead wait in RX ring */
+        if (p_opt->window * (FLASH_WRITE_SEQ_SZ + p_opt->chunk_sz)
+                > RX_RING_SZ)
         {
-            /* Wait for 'cksum_len' bytes */
+            return CBL_ERR_WINDOW;
         }
+    }
+
+    eCode = write_get_compress(ph_prsr, p_opt);
+    ERR_CHECK(eCode);
 
-        eCode = verify_checksum(write_buf, cksum_len, cksum, &h_cksum_sha256);
+    /* Get number of runs, optional parameter */
+    charRuns = parser_get_val(ph_prsr, TXT_PAR_FLASH_WRITE_RUNS,
+            strlen(TXT_PAR_FLASH_WRITE_RUNS));
+    if (charRuns != NULL)
+    {
+        eCode = str2ui32(charRuns, strlen(charRuns), &p_opt->runs, 10);
         ERR_CHECK(eCode);
+
+        /* Decoder reads history back from flash, gaps would break it */
+        if (0 == p_opt->runs || p_opt->runs > FLASH_WRITE_MAX_RUNS
+                || p_opt->compress != COMPRESS_NO)
+        {
+            return CBL_ERR_SPARSE;
+        }
     }
+
+    eCode = write_get_diff(ph_prsr, p_opt);
+    ERR_CHECK(eCode);
+
+    eCode = write_get_erase(ph_prsr, p_opt);
+
     return eCode;
 }
 
 /**
- * @brief Gets parameters from parser handle
+ * @brief Gets optional differential parameter
  *
  * @param ph_prsr[in] Parser containing parameters
- * @param p_start[out] Pointer of start address
- * @param p_len[out] Pointer to length to write
- * @param p_cksum[out] Pointer to checksum enumerator
+ * @param p_opt[out]  Transfer options
  */
-static cbl_err_code_t write_get_params (parser_t * ph_prsr, uint32_t * p_start,
-        uint32_t * p_len, cksum_t * p_cksum)
+static cbl_err_code_t write_get_diff (parser_t * ph_prsr,
+        flash_write_opt_t * p_opt)
 {
-    cbl_err_code_t eCode = CBL_ERR_OK;
-    char *charStart = NULL;
-    char *charLen = NULL;
-    char *charChecksum = NULL;
+    char *charDiff = NULL;
+    uint32_t len;
 
-    /* Get starting address */
-    charStart = parser_get_val(ph_prsr, TXT_PAR_FLASH_WRITE_START,
-            strlen(TXT_PAR_FLASH_WRITE_START));
-    if (NULL == charStart)
+    p_opt->is_diff = false;
+
+    charDiff = parser_get_val(ph_prsr, TXT_PAR_FLASH_WRITE_DIFF,
+            strlen(TXT_PAR_FLASH_WRITE_DIFF));
+    if (NULL == charDiff)
     {
-        return CBL_ERR_NEED_PARAM;
+        return CBL_ERR_OK;
     }
-    /* Get length in bytes */
-    charLen = parser_get_val(ph_prsr, TXT_PAR_FLASH_WRITE_COUNT,
-            strlen(TXT_PAR_FLASH_WRITE_COUNT));
-    if (NULL == charLen)
+
+    len = strlen(charDiff);
+
+    if (strlen(TXT_PAR_FLASH_WRITE_TRUE) == len
+            && strncmp(charDiff, TXT_PAR_FLASH_WRITE_TRUE, len) == 0)
     {
-        return CBL_ERR_NEED_PARAM;
+        p_opt->is_diff = true;
+    }
+    else if (strlen(TXT_PAR_FLASH_WRITE_FALSE) != len
+            || strncmp(charDiff, TXT_PAR_FLASH_WRITE_FALSE, len) != 0)
+    {
+        return CBL_ERR_PAR_DIFF;
     }
 
-    /* Get checksum to be used */
-    charChecksum = parser_get_val(ph_prsr, TXT_PAR_CKSUM,
-            strlen(TXT_PAR_CKSUM));
-    /* This is an optional parameter, if it is not present, don't throw error */
+    return CBL_ERR_OK;
+}
 
-    /* Fill start */
-    eCode = str2ui32(charStart, strlen(charStart), p_start, 16);
-    ERR_CHECK(eCode);
+/**
+ * @brief Gets optional erase parameter, ERASE_DEFAULT if not present.
+ *        Automatic erase of differential transfer is rejected here, before
+ *        the command changes anything.
+ *
+ * @param ph_prsr[in]    Parser containing parameters
+ * @param p_opt[in,out]  Transfer options, 'is_diff' is already set
+ */
+static cbl_err_code_t write_get_erase (parser_t * ph_prsr,
+        flash_write_opt_t * p_opt)
+{
+    char *charErase = NULL;
+    uint32_t len;
 
-    /* Fill len */
-    eCode = str2ui32(charLen, strlen(charLen), p_len, 10);
-    ERR_CHECK(eCode);
+    p_opt->erase = ERASE_DEFAULT;
 
-    eCode = hal_verify_flash_address(*p_start);
-    ERR_CHECK(eCode);
+    charErase = parser_get_val(ph_prsr, TXT_PAR_FLASH_WRITE_ERASE,
+            strlen(TXT_PAR_FLASH_WRITE_ERASE));
+    if (NULL == charErase)
+    {
+        return CBL_ERR_OK;
+    }
 
-    eCode = hal_verify_flash_address((*p_start) + (*p_len) - 1);
-    ERR_CHECK(eCode);
+    len = strlen(charErase);
 
-    eCode = enum_checksum(charChecksum, strlen(charChecksum), p_cksum);
-    ERR_CHECK(eCode);
+    if (strlen(TXT_PAR_FLASH_WRITE_ERASE_AUTO) == len
+            && strncmp(charErase, TXT_PAR_FLASH_WRITE_ERASE_AUTO, len) == 0)
+    {
+        p_opt->erase = ERASE_AUTO;
+    }
+    else if (strlen(TXT_PAR_FLASH_WRITE_ERASE_NO) == len
+            && strncmp(charErase, TXT_PAR_FLASH_WRITE_ERASE_NO, len) == 0)
+    {
+        p_opt->erase = ERASE_NO;
+    }
+    else
+    {
+        return CBL_ERR_PAR_ERASE;
+    }
 
-    if ((( *p_len) == 0) || (( *p_cksum == CKSUM_CRC32) && ( *p_len % 4 != 0)))
+    /* Erased sector would lose bytes that matched */
+    if (ERASE_AUTO == p_opt->erase && p_opt->is_diff)
     {
-        return CBL_ERR_CRC_LEN;
+        return CBL_ERR_PAR_ERASE;
     }
 
-    return eCode;
+    return CBL_ERR_OK;
+}
+
+/**
+ * @brief Gets compression parameters, compressed length is needed only with
+ *        compression
+ *
+ * @param ph_prsr[in] Parser containing parameters
+ * @param p_opt[out]  Transfer options
+ */
+static cbl_err_code_t write_get_compress (parser_t * ph_prsr,
+        flash_write_opt_t * p_opt)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    char *charCompress = NULL;
+    char *charZlen = NULL;
+
+    p_opt->compress = COMPRESS_NO;
+    p_opt->zlen = 0;
+
+    charCompress = parser_get_val(ph_prsr, TXT_PAR_FLASH_WRITE_COMPRESS,
+            strlen(TXT_PAR_FLASH_WRITE_COMPRESS));
+    if (NULL == charCompress)
+    {
+        return eCode;
+    }
+
+    if (strlen(charCompress) == strlen(TXT_COMPRESS_LZ4)
+            && strncmp(charCompress, TXT_COMPRESS_LZ4,
+                    strlen(TXT_COMPRESS_LZ4)) == 0)
+    {
+        p_opt->compress = COMPRESS_LZ4;
+    }
+    else if (strlen(charCompress) == strlen(TXT_COMPRESS_NO)
+            && strncmp(charCompress, TXT_COMPRESS_NO, strlen(TXT_COMPRESS_NO))
+                    == 0)
+    {
+        return eCode;
+    }
+    else
+    {
+        return CBL_ERR_COMPRESS;
+    }
+
+    charZlen = parser_get_val(ph_prsr, TXT_PAR_FLASH_WRITE_ZCOUNT,
+            strlen(TXT_PAR_FLASH_WRITE_ZCOUNT));
+    if (NULL == charZlen)
+    {
+        return CBL_ERR_NEED_PARAM;
+    }
+
+    eCode = str2ui32(charZlen, strlen(charZlen), &p_opt->zlen, 10);
+    ERR_CHECK(eCode);
+
+    if (0 == p_opt->zlen)
+    {
+        return CBL_ERR_INV_SZ;
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Receives chunks with the text handshake. As soon as a chunk is
+ *        received the host is asked for the next one, which is received into
+ *        RX ring while the current one is written to flash and accumulated
+ *        into the checksum.
+ *
+ * @note  "chunk OK" confirms that the chunk was received. Error while writing
+ *        a chunk to flash is reported instead of the next "chunk OK".
+ *
+ * @param start[in]     Starting address
+ * @param len[in]       Number of bytes to write
+ * @param chunk_sz[in]  Size of every chunk except the last one
+ * @param n_chunks[in]  Number of chunks 'len' is split into
+ * @param p_ctx[in]     Transfer state
+ */
+static cbl_err_code_t write_chunks_handshake (uint32_t start, uint32_t len,
+        uint32_t chunk_sz, uint32_t n_chunks, write_ctx_t * p_ctx)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t iii = 0;
+    uint32_t chunk_addr = start;
+    char chunk_succ[] = "\r\nchunk OK\r\n";
+
+    /* Resumed transfer may have nothing left, checksum follows at once */
+    if (0 == n_chunks)
+    {
+        return eCode;
+    }
+
+    /* Request the first chunk */
+    eCode = write_request_chunk(iii, write_chunk_len(len, chunk_sz, iii),
+            chunk_addr);
+    ERR_CHECK(eCode);
+
+    /* Get chunks one by one from host, and write them to memory, accumulating
+     * checksum */
+    while (iii < n_chunks)
+    {
+        uint32_t chunk_len = write_chunk_len(len, chunk_sz, iii);
+
+        /* Wait for 'chunk_len' bytes */
+        eCode = rx_ring_recv(write_buf, chunk_len, CBL_RX_TIMEOUT_MS);
+        ERR_CHECK(eCode);
+
+        eCode = tx_queue_send(chunk_succ, strlen(chunk_succ));
+        ERR_CHECK(eCode);
+
+        /* Let the host send the next chunk while this one is being written */
+        if ((iii + 1) < n_chunks)
+        {
+            eCode = write_request_chunk(iii + 1,
+                    write_chunk_len(len, chunk_sz, iii + 1),
+                    chunk_addr + chunk_len);
+            ERR_CHECK(eCode);
+        }
+
+        eCode = write_chunk(p_ctx, chunk_addr, write_buf, chunk_len);
+        if (eCode != CBL_ERR_OK)
+        {
+            /* Next chunk will never be used, drop it */
+            rx_ring_flush();
+        }
+        ERR_CHECK(eCode);
+
+        chunk_addr += chunk_len;
+        iii++;
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Receives chunks streamed by the host. Host sends up to 'window'
+ *        chunks, each preceded by its sequence number (4 bytes, little
+ *        endian), without waiting for a response. Bootloader answers with a
+ *        cumulative "ack:N" meaning all chunks before N were received in order
+ *        and the host can send chunks up to N + window - 1. Chunks sent ahead
+ *        wait in RX ring while the previous one is written to flash.
+ *
+ * @note  Error while writing to flash is reported instead of the next ack.
+ *
+ * @param start[in]     Starting address
+ * @param len[in]       Number of bytes to write
+ * @param chunk_sz[in]  Size of every chunk except the last one
+ * @param n_chunks[in]  Number of chunks 'len' is split into
+ * @param window[in]    Number of chunks host can send without waiting for ack
+ * @param p_ctx[in]     Transfer state
+ */
+static cbl_err_code_t write_chunks_windowed (uint32_t start, uint32_t len,
+        uint32_t chunk_sz, uint32_t n_chunks, uint32_t window,
+        write_ctx_t * p_ctx)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t chunk_addr = start;
+    uint32_t acked = 0; /* Chunks acknowledged to the host */
+    /* Acknowledge every half of the window so host never waits for it */
+    uint32_t ack_every = (window + 1) / 2;
+    char chunk_info[32] = { 0 };
+
+    /* Resumed transfer may have nothing left, checksum follows at once */
+    if (0 == n_chunks)
+    {
+        return eCode;
+    }
+
+    /* Notify host how many chunks can be sent ahead */
+    snprintf(chunk_info, sizeof(chunk_info), "\r\nwindow:%lu\r\n", window);
+    eCode = tx_queue_send(chunk_info, strlen(chunk_info));
+    ERR_CHECK(eCode);
+
+    eCode = tx_queue_send(TXT_RESP_FLASH_WRITE_READY,
+            strlen(TXT_RESP_FLASH_WRITE_READY));
+    ERR_CHECK(eCode);
+
+    for (uint32_t iii = 0; iii < n_chunks; iii++)
+    {
+        uint32_t chunk_len = write_chunk_len(len, chunk_sz, iii);
+        uint32_t seq;
+
+        /* Wait for sequence number and 'chunk_len' bytes */
+        eCode = rx_ring_recv(write_buf, FLASH_WRITE_SEQ_SZ + chunk_len,
+                CBL_RX_TIMEOUT_MS);
+        ERR_CHECK(eCode);
+
+        /* WARNING: Little endian assumed */
+        memcpy( &seq, write_buf, FLASH_WRITE_SEQ_SZ);
+
+        if (seq != iii)
+        {
+            /* Chunks sent ahead are out of order as well */
+            rx_ring_flush();
+            return CBL_ERR_CHUNK_SEQ;
+        }
+
+        if ((iii + 1 - acked) >= ack_every || (iii + 1) == n_chunks)
+        {
+            acked = iii + 1;
+
+            snprintf(chunk_info, sizeof(chunk_info), "\r\nack:%lu\r\n", acked);
+            eCode = tx_queue_send(chunk_info, strlen(chunk_info));
+            ERR_CHECK(eCode);
+        }
+
+        eCode = write_chunk(p_ctx, chunk_addr, &write_buf[FLASH_WRITE_SEQ_SZ],
+                chunk_len);
+        if (eCode != CBL_ERR_OK)
+        {
+            /* Chunks sent ahead will never be used, drop them */
+            rx_ring_flush();
+        }
+        ERR_CHECK(eCode);
+
+        chunk_addr += chunk_len;
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Passes received chunk through the transfer stages: decompression or
+ *        splitting into runs if used, then writing to flash and recording
+ *        progress to the journal
+ *
+ * @param p_ctx[in]      Transfer state
+ * @param chunk_addr[in] Address to write the chunk to, if not compressed
+ * @param p_chunk[in]    Chunk bytes
+ * @param chunk_len[in]  Length of the chunk
+ */
+static cbl_err_code_t write_chunk (write_ctx_t * p_ctx, uint32_t chunk_addr,
+        uint8_t * p_chunk, uint32_t chunk_len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    if (p_ctx->p_lz4 != NULL)
+    {
+        /* Decompressed bytes are written by the decoder */
+        return lz4_feed(p_ctx->p_lz4, p_chunk, chunk_len);
+    }
+
+    if (p_ctx->n_runs != 0)
+    {
+        return write_sparse(p_ctx, p_chunk, chunk_len);
+    }
+
+    eCode = write_program(chunk_addr, p_chunk, chunk_len, p_ctx);
+    ERR_CHECK(eCode);
+
+    if (p_ctx->is_journal)
+    {
+        p_ctx->done += chunk_len;
+        eCode = journal_commit(p_ctx->done);
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Writes bytes to flash and accumulates them into the checksum. In
+ *        differential transfer only bytes that differ from flash are written.
+ *        With automatic erase sectors the bytes land in are erased first.
+ *
+ * @param addr[in]  Address to write to
+ * @param buf[in]   Bytes to write
+ * @param len[in]   Number of bytes
+ * @param p_ctx[in] Transfer state, write_ctx_t
+ */
+static cbl_err_code_t write_program (uint32_t addr, uint8_t * buf,
+        uint32_t len, void * p_ctx)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    write_ctx_t *p_wctx = p_ctx;
+
+    if (p_wctx->is_diff && flash_compare(addr, buf, len) == FLASH_CMP_ERASE)
+    {
+        return CBL_ERR_NOT_ERASED;
+    }
+
+    eCode = write_erase(p_wctx, addr + len);
+    ERR_CHECK(eCode);
+
+    hal_led_on(LED_MEMORY);
+    if (p_wctx->is_diff)
+    {
+        eCode = flash_program_diff(addr, buf, len, &p_wctx->skipped);
+    }
+    else
+    {
+        eCode = hal_write_program_bytes(addr, buf, len);
+    }
+    hal_led_off(LED_MEMORY);
+    ERR_CHECK(eCode);
+
+    eCode = accumulate_checksum(buf, len, p_wctx->cksum, &p_wctx->h_cksum);
+    ERR_CHECK(eCode);
+
+    return eCode;
+}
+
+/**
+ * @brief Receives the run table of sparse transfer. Every run is offset (4)
+ *        and length (4), little endian. Runs shall be in order, not overlap
+ *        and be aligned to 4 bytes, because of CRC32 and flash programming.
+ *
+ * @param len[in]         Length of the whole image
+ * @param p_ctx[in]       Transfer state with number of runs
+ * @param p_xfer_len[out] Number of bytes in all runs, sent by the host
+ */
+static cbl_err_code_t write_get_runs (uint32_t len, write_ctx_t * p_ctx,
+        uint32_t * p_xfer_len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    char runs_info[32] = { 0 };
+    uint32_t table_len = p_ctx->n_runs * FLASH_WRITE_RUN_SZ;
+    uint32_t end = 0;
+
+    /* Notify host run table is expected */
+    snprintf(runs_info, sizeof(runs_info), "\r\nruns|length:%lu\r\n",
+            table_len);
+    eCode = tx_queue_send(runs_info, strlen(runs_info));
+    ERR_CHECK(eCode);
+
+    eCode = tx_queue_send(TXT_RESP_FLASH_WRITE_READY,
+            strlen(TXT_RESP_FLASH_WRITE_READY));
+    ERR_CHECK(eCode);
+
+    /* WARNING: Little endian assumed */
+    eCode = rx_ring_recv((uint8_t *)write_runs, table_len, CBL_RX_TIMEOUT_MS);
+    ERR_CHECK(eCode);
+
+    *p_xfer_len = 0;
+    for (uint32_t iii = 0; iii < p_ctx->n_runs; iii++)
+    {
+        write_run_t *p_run = &write_runs[iii];
+
+        if (p_run->offset < end || 0 == p_run->len || p_run->offset % 4 != 0
+                || p_run->len % 4 != 0 || p_run->len > len
+                || p_run->offset > len - p_run->len)
+        {
+            return CBL_ERR_SPARSE;
+        }
+
+        end = p_run->offset + p_run->len;
+        *p_xfer_len += p_run->len;
+    }
+
+    p_ctx->run = 0;
+    p_ctx->run_done = 0;
+    p_ctx->img_pos = 0;
+
+    return eCode;
+}
+
+/**
+ * @brief Writes bytes of runs to their place in the image. Erased bytes before
+ *        a run are accumulated into the checksum when it starts.
+ *
+ * @param p_ctx[in]     Transfer state
+ * @param p_chunk[in]   Bytes of runs
+ * @param chunk_len[in] Number of bytes
+ */
+static cbl_err_code_t write_sparse (write_ctx_t * p_ctx, uint8_t * p_chunk,
+        uint32_t chunk_len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    while (chunk_len > 0)
+    {
+        write_run_t *p_run = &write_runs[p_ctx->run];
+        uint32_t len;
+
+        if (0 == p_ctx->run_done)
+        {
+            eCode = write_gap(p_ctx, p_run->offset);
+            ERR_CHECK(eCode);
+        }
+
+        len = ui32_min(chunk_len, p_run->len - p_ctx->run_done);
+
+        eCode = write_program(p_ctx->start + p_ctx->img_pos, p_chunk, len,
+                p_ctx);
+        ERR_CHECK(eCode);
+
+        p_chunk += len;
+        chunk_len -= len;
+        p_ctx->img_pos += len;
+        p_ctx->run_done += len;
+
+        if (p_ctx->run_done == p_run->len)
+        {
+            p_ctx->run++;
+            p_ctx->run_done = 0;
+        }
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Accumulates erased bytes (0xFF) up to 'offset' into the checksum.
+ *        They are not written, flash shall be erased, else the checksum
+ *        would match bytes the flash doesn't hold, as with differential
+ *        transfer over the old image. With automatic erase sectors of the
+ *        gap are erased here.
+ *
+ * @param p_ctx[in]  Transfer state
+ * @param offset[in] Offset in the image where the gap ends
+ */
+static cbl_err_code_t write_gap (write_ctx_t * p_ctx, uint32_t offset)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint8_t erased[64];
+
+    memset(erased, 0xFF, sizeof(erased));
+
+    eCode = write_erase(p_ctx, p_ctx->start + offset);
+    ERR_CHECK(eCode);
+
+    if (false == p_ctx->is_erase_auto && p_ctx->img_pos < offset
+            && flash_is_erased(p_ctx->start + p_ctx->img_pos,
+                    offset - p_ctx->img_pos) == false)
+    {
+        return CBL_ERR_NOT_ERASED;
+    }
+
+    while (p_ctx->img_pos < offset)
+    {
+        uint32_t len = ui32_min(offset - p_ctx->img_pos, sizeof(erased));
+
+        eCode = accumulate_checksum(erased, len, p_ctx->cksum,
+                &p_ctx->h_cksum);
+        ERR_CHECK(eCode);
+
+        p_ctx->img_pos += len;
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Erases sectors between flash erased so far and 'end', if automatic
+ *        erase is used. Every sector is erased once per transfer.
+ *
+ * @param p_ctx[in,out] Transfer state
+ * @param end[in]       Address following the bytes about to be written
+ */
+static cbl_err_code_t write_erase (write_ctx_t * p_ctx, uint32_t end)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    if (false == p_ctx->is_erase_auto || end <= p_ctx->erased_end)
+    {
+        return eCode;
+    }
+
+    hal_led_on(LED_MEMORY);
+    eCode = flash_erase(p_ctx->erased_end, end - p_ctx->erased_end);
+    hal_led_off(LED_MEMORY);
+    ERR_CHECK(eCode);
+
+    p_ctx->erased_end = flash_get_sector_end(end - 1);
+
+    return eCode;
+}
+
+/**
+ * @brief Returns length of the chunk
+ *
+ * @param len[in]       Number of bytes of the whole transfer
+ * @param chunk_sz[in]  Size of every chunk except the last one
+ * @param chunk_num[in] Number of the chunk
+ */
+static uint32_t write_chunk_len (uint32_t len, uint32_t chunk_sz,
+        uint32_t chunk_num)
+{
+    return ui32_min(len - chunk_num * chunk_sz, chunk_sz);
+}
+
+/**
+ * @brief Notifies the host about the chunk and that it can be sent
+ *
+ * @param chunk_num[in]  Number of the chunk
+ * @param chunk_len[in]  Length of the chunk
+ * @param chunk_addr[in] Address the chunk will be written to
+ */
+static cbl_err_code_t write_request_chunk (uint32_t chunk_num,
+        uint32_t chunk_len, uint32_t chunk_addr)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    char chunk_info[64] = { 0 };
+
+    /* Notify host about current chunk number and length */
+    snprintf(chunk_info, sizeof(chunk_info),
+            "\r\nchunk:%lu|length:%lu|address:0x%08lx\r\n", chunk_num,
+            chunk_len, chunk_addr);
+    eCode = tx_queue_send(chunk_info, strlen(chunk_info));
+    ERR_CHECK(eCode);
+
+    /* Notify host to send the bytes */
+    eCode = tx_queue_send(TXT_RESP_FLASH_WRITE_READY,
+            strlen(TXT_RESP_FLASH_WRITE_READY));
+
+    return eCode;
+}
+
+/**
+ * @brief Gets parameters from parser handle
+ *
+ * @param ph_prsr[in] Parser containing parameters
+ * @param p_start[out] Pointer of start address
+ * @param p_len[out] Pointer to length to write
+ * @param p_cksum[out] Pointer to checksum enumerator
+ */
+static cbl_err_code_t write_get_params (parser_t * ph_prsr, uint32_t * p_start,
+        uint32_t * p_len, cksum_t * p_cksum)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    char *charStart = NULL;
+    char *charLen = NULL;
+    char *charChecksum = NULL;
+
+    /* Get starting address */
+    charStart = parser_get_val(ph_prsr, TXT_PAR_FLASH_WRITE_START,
+            strlen(TXT_PAR_FLASH_WRITE_START));
+    if (NULL == charStart)
+    {
+        return CBL_ERR_NEED_PARAM;
+    }
+    /* Get length in bytes */
+    charLen = parser_get_val(ph_prsr, TXT_PAR_FLASH_WRITE_COUNT,
+            strlen(TXT_PAR_FLASH_WRITE_COUNT));
+    if (NULL == charLen)
+    {
+        return CBL_ERR_NEED_PARAM;
+    }
+
+    /* Get checksum to be used */
+    charChecksum = parser_get_val(ph_prsr, TXT_PAR_CKSUM,
+            strlen(TXT_PAR_CKSUM));
+    /* This is an optional parameter, if it is not present, don't throw error */
+
+    /* Fill start */
+    eCode = str2ui32(charStart, strlen(charStart), p_start, 16);
+    ERR_CHECK(eCode);
+
+    /* Fill len */
+    eCode = str2ui32(charLen, strlen(charLen), p_len, 10);
+    ERR_CHECK(eCode);
+
+    eCode = hal_verify_flash_address(*p_start);
+    ERR_CHECK(eCode);
+
+    eCode = hal_verify_flash_address((*p_start) + (*p_len) - 1);
+    ERR_CHECK(eCode);
+
+    eCode = enum_checksum(charChecksum, strlen(charChecksum), p_cksum);
+    ERR_CHECK(eCode);
+
+    if ((( *p_len) == 0)
+            || ( *p_len % checksum_get_multiple( *p_cksum) != 0))
+    {
+        return CBL_ERR_CRC_LEN;
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Streams bytes from memory in frames, consecutive frames of 0x00 or
+ *        0xFF are merged into one run. Every frame has the form, all fields
+ *        little endian:
+ *
+ *        | type (1) | offset (4) | length (4) | payload | CRC16 (2) |
+ *
+ *        Offset is from 'start', payload is 'length' bytes of a data frame or
+ *        one repeated byte of a run. CRC16 is the one of binary protocol,
+ *        calculated over type, offset, length and payload. Frame
+ *        MEM_READ_DONE ends the stream, then host sends offsets (4) of frames
+ *        to be sent again, MEM_READ_END when it has all of them.
+ *
+ * @param start[in]    Starting address
+ * @param len[in]      Number of bytes to read
+ * @param frame_sz[in] Size of every frame except the last one
+ */
+static cbl_err_code_t read_stream (uint32_t start, uint32_t len,
+        uint32_t frame_sz)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t offset = 0;
+    uint8_t req[4];
+
+    while (offset < len)
+    {
+        eCode = read_frames(start, len, frame_sz, offset, true, &offset);
+        ERR_CHECK(eCode);
+    }
+
+    eCode = read_send(MEM_READ_DONE, len, 0, NULL, 0);
+    ERR_CHECK(eCode);
+
+    /* Frames host got corrupted are sent again one by one */
+    while (true)
+    {
+        eCode = rx_ring_recv(req, sizeof(req), CBL_RX_TIMEOUT_MS);
+        ERR_CHECK(eCode);
+
+        offset = frame_get_ui32(req);
+        if (MEM_READ_END == offset)
+        {
+            break;
+        }
+
+        if (offset >= len || offset % frame_sz != 0)
+        {
+            return CBL_ERR_READ_RESEND;
+        }
+
+        eCode = read_frames(start, len, frame_sz, offset, false, &offset);
+        ERR_CHECK(eCode);
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Sends the frame starting at 'offset' as data or as a run
+ *
+ * @param start[in]    Starting address of the read
+ * @param len[in]      Number of bytes of the read
+ * @param frame_sz[in] Size of every frame except the last one
+ * @param offset[in]   Offset of the frame, multiple of 'frame_sz'
+ * @param is_merge[in] Following frames of the same run are sent with it
+ * @param p_next[out]  Offset of the first frame not sent
+ */
+static cbl_err_code_t read_frames (uint32_t start, uint32_t len,
+        uint32_t frame_sz, uint32_t offset, bool is_merge, uint32_t * p_next)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    const uint8_t *p_frame = (const uint8_t *)(start + offset);
+    uint32_t frame_len = frame_sz;
+    uint32_t run_len;
+    uint8_t fill = p_frame[0];
+
+    if (len - offset < frame_len)
+    {
+        frame_len = len - offset;
+    }
+
+    if ((fill != 0x00 && fill != 0xFF) || !read_is_run(p_frame, frame_len, fill))
+    {
+        eCode = read_send(MEM_READ_DATA, offset, frame_len, p_frame, frame_len);
+        *p_next = offset + frame_len;
+        return eCode;
+    }
+
+    run_len = frame_len;
+
+    while (is_merge && run_len < len - offset)
+    {
+        frame_len = frame_sz;
+        if (len - offset - run_len < frame_len)
+        {
+            frame_len = len - offset - run_len;
+        }
+
+        if (!read_is_run( &p_frame[run_len], frame_len, fill))
+        {
+            break;
+        }
+
+        run_len += frame_len;
+    }
+
+    eCode = read_send(MEM_READ_RUN, offset, run_len, &fill, 1);
+    *p_next = offset + run_len;
+
+    return eCode;
+}
+
+/**
+ * @brief Sends one frame of streamed read, it is queued in pieces and leaves
+ *        in one transmission
+ *
+ * @param type[in]        Type of the frame
+ * @param offset[in]      Offset of the first byte from the start of the read
+ * @param len[in]         Number of bytes frame stands for
+ * @param p_payload[in]   Payload, NULL if there is none
+ * @param payload_len[in] Length of 'p_payload'
+ */
+static cbl_err_code_t read_send (mem_read_type_t type, uint32_t offset,
+        uint32_t len, const uint8_t * p_payload, uint32_t payload_len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint8_t hdr[MEM_READ_HDR_SZ];
+    uint8_t crc_buf[2];
+    uint16_t crc;
+
+    hdr[0] = (uint8_t)type;
+    frame_put_ui32( &hdr[1], offset);
+    frame_put_ui32( &hdr[5], len);
+
+    crc = frame_crc16(0xFFFF, hdr, sizeof(hdr));
+    crc = frame_crc16(crc, p_payload, payload_len);
+    crc_buf[0] = (uint8_t)(crc & 0xFF);
+    crc_buf[1] = (uint8_t)(crc >> 8);
+
+    eCode = tx_queue_send((char *)hdr, sizeof(hdr));
+    ERR_CHECK(eCode);
+
+    if (payload_len > 0)
+    {
+        eCode = tx_queue_send((const char *)p_payload, payload_len);
+        ERR_CHECK(eCode);
+    }
+
+    return tx_queue_send((char *)crc_buf, sizeof(crc_buf));
+}
+
+/**
+ * @brief Checks if all bytes are equal to 'fill'
+ */
+static bool read_is_run (const uint8_t * buf, uint32_t len, uint8_t fill)
+{
+    for (uint32_t iii = 0; iii < len; iii++)
+    {
+        if (buf[iii] != fill)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Gets start, count and algo parameters of mem-hash and mem-map
+ *
+ * @param ph_prsr[in]     Parser with the command
+ * @param p_start[out]    Starting address
+ * @param p_len[out]      Number of bytes
+ * @param p_cksum[in,out] Checksum, left as it is if algo is not present
+ */
+static cbl_err_code_t hash_get_params (parser_t * ph_prsr, uint32_t * p_start,
+        uint32_t * p_len, cksum_t * p_cksum)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    char *charStart = NULL;
+    char *charLen = NULL;
+    char *charAlgo = NULL;
+
+    charStart = parser_get_val(ph_prsr, TXT_PAR_FLASH_WRITE_START,
+            strlen(TXT_PAR_FLASH_WRITE_START));
+    charLen = parser_get_val(ph_prsr, TXT_PAR_FLASH_WRITE_COUNT,
+            strlen(TXT_PAR_FLASH_WRITE_COUNT));
+    if (NULL == charStart || NULL == charLen)
+    {
+        return CBL_ERR_NEED_PARAM;
+    }
+
+    eCode = str2ui32(charStart, strlen(charStart), p_start, 16);
+    ERR_CHECK(eCode);
+
+    eCode = str2ui32(charLen, strlen(charLen), p_len, 10);
+    ERR_CHECK(eCode);
+
+    charAlgo = parser_get_val(ph_prsr, TXT_PAR_MEM_HASH_ALGO,
+            strlen(TXT_PAR_MEM_HASH_ALGO));
+    if (NULL == charAlgo)
+    {
+        return eCode;
+    }
+
+    eCode = enum_checksum(charAlgo, strlen(charAlgo), p_cksum);
+    ERR_CHECK(eCode);
+
+    /* There is nothing to send without a checksum */
+    if (CKSUM_NO == *p_cksum)
+    {
+        return CBL_ERR_UNSUP_CKSUM;
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Calculates checksum of memory and sends it as lowercase hex line, in
+ *        the byte order host sends checksums with. Flash is memory mapped, it
+ *        is hashed where it is.
+ *
+ * @param start[in] Starting address
+ * @param len[in]   Number of bytes, multiple of checksum_get_multiple()
+ * @param cksum[in] Checksum to calculate
+ */
+static cbl_err_code_t hash_send (uint32_t start, uint32_t len, cksum_t cksum)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    cksum_ctx_t h_cksum;
+    uint8_t digest[CKSUM_MAX_DIGEST_SZ];
+    char hex[2 * CKSUM_MAX_DIGEST_SZ + 3] = { 0 };
+    uint32_t digest_len = checksum_get_length(cksum);
+
+    init_checksum(cksum, &h_cksum);
+
+    eCode = accumulate_checksum((uint8_t *)start, len, cksum, &h_cksum);
+    ERR_CHECK(eCode);
+
+    eCode = final_checksum(cksum, &h_cksum, digest);
+    ERR_CHECK(eCode);
+
+    for (uint32_t iii = 0; iii < digest_len; iii++)
+    {
+        snprintf( &hex[2 * iii], 3, "%02x", digest[iii]);
+    }
+    snprintf( &hex[2 * digest_len], 3, CRLF);
+
+    return tx_queue_send(hex, strlen(hex));
 }
 
 /*** end of file ***/
@@ -4,6 +4,7 @@
  */
 #include "commands/cbl_cmds_opt_bytes.h"
 #include "etc/cbl_common.h"
+#include "etc/cbl_tx_queue.h"
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdlib.h>
@@ -24,7 +25,7 @@ cbl_err_code_t cmd_get_rdp_lvl (parser_t * phPrsr)
     hal_rdp_lvl_get(rdp_lvl, sizeof(rdp_lvl));
 
     /* Send response */
-    eCode = hal_send_to_host(rdp_lvl, strlen(rdp_lvl));
+    eCode = tx_queue_send(rdp_lvl, strlen(rdp_lvl));
 
     return eCode;
 }
@@ -79,7 +80,7 @@ cbl_err_code_t cmd_get_write_prot (parser_t * phPrsr)
     ERR_CHECK(eCode);
 
     /* Send response */
-    eCode = hal_send_to_host(write_prot, strlen(write_prot));
+    eCode = tx_queue_send(write_prot, strlen(write_prot));
 
     return eCode;
 }
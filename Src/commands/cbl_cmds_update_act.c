@@ -4,6 +4,10 @@
  *        record
  */
 #include "etc/cbl_boot_record.h"
+#include "etc/cbl_patch.h"
+#include "etc/cbl_flash.h"
+#include "etc/cbl_retained.h"
+#include "etc/cbl_tx_queue.h"
 #include "commands/cbl_cmds_memory.h"
 #include "commands/cbl_cmds_update_act.h"
 #include <stdbool.h>
@@ -18,12 +22,19 @@ typedef struct
     uint32_t * p_main; /*!< Set by function 05, BIG ENDIAN */
 } h_ihex_t;
 
-static cbl_err_code_t update_act (app_type_t app_type, uint32_t new_len);
-static cbl_err_code_t update_act_bin (uint32_t new_len);
-static cbl_err_code_t update_act_hex (uint32_t new_len);
-static cbl_err_code_t update_act_srec (uint32_t new_len);
 static cbl_err_code_t enum_param_force (char * char_force, uint32_t len,
 bool * p_force);
+#if 1 == CBL_AB_SLOTS
+static cbl_err_code_t update_act_switch (boot_record_t * p_boot_record);
+#else
+static cbl_err_code_t update_act_copy (boot_record_t * p_boot_record);
+static cbl_err_code_t update_act (app_type_t app_type, uint32_t new_addr,
+        uint32_t new_len);
+static cbl_err_code_t update_act_bin (uint32_t new_addr, uint32_t new_len);
+static cbl_err_code_t update_act_patch (boot_record_t * p_boot_record,
+        uint32_t * p_new_addr, uint32_t * p_new_len);
+static cbl_err_code_t update_act_hex (uint32_t new_len);
+static cbl_err_code_t update_act_srec (uint32_t new_len);
 static cbl_err_code_t hex_handle_fcn (h_ihex_t * ph_ihex, uint8_t * p_fcn_start,
         uint32_t len, uint32_t * p_fcn_len);
 static cbl_err_code_t srec_handle_fcn (uint8_t * p_fcn_start, uint32_t len,
@@ -42,9 +53,12 @@ static cbl_err_code_t hex_handle_fcn_04 (h_ihex_t * ph_ihex,
 static cbl_err_code_t hex_handle_fcn_05 (h_ihex_t * ph_ihex,
         uint8_t * p_fcn_start, uint16_t fcn_address, uint8_t byte_count,
         uint64_t calc_checksum, uint8_t expected_checksum);
+#endif /* 1 == CBL_AB_SLOTS */
 /**
  * @brief Checks 'boot record' if update to user application is available.
- *        If it is available updates the user application.
+ *        If it is available updates the user application. With CBL_AB_SLOTS
+ *        application in the other slot is started instead, forcing it rolls
+ *        back to the previous application.
  *        Parameters from phPrsr:
  *          force - force update even if flag for update is not set
  *                  valid values TXT_PAR_UP_ACT_TRUE and TXT_PAR_UP_ACT_FALSE
@@ -55,12 +69,10 @@ cbl_err_code_t cmd_update_act (parser_t * phPrsr)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
     boot_record_t * p_boot_record;
-    uint32_t new_len;
 
     p_boot_record = boot_record_get();
-    new_len = p_boot_record->new_app.len;
 
-    if (p_boot_record->is_new_app_ready == false)
+    if (retained_flag_get(RETAINED_NEW_APP_READY) == false)
     {
         char *char_force = NULL;
         bool force = false;
@@ -68,7 +80,7 @@ cbl_err_code_t cmd_update_act (parser_t * phPrsr)
         /* Notify that no update is required */
         const char *msg = "No update needed for user application\r\n";
         INFO("%s", msg);
-        eCode = hal_send_to_host(msg, strlen(msg));
+        eCode = tx_queue_send(msg, strlen(msg));
         ERR_CHECK(eCode);
 
         /* Check if force parameter is given */
@@ -91,37 +103,68 @@ cbl_err_code_t cmd_update_act (parser_t * phPrsr)
         /* Notify that update is available */
         const char *msg = "Update for user application available\r\n";
         INFO("%s", msg);
-        eCode = hal_send_to_host(msg, strlen(msg));
+        eCode = tx_queue_send(msg, strlen(msg));
         ERR_CHECK(eCode);
     }
 
     const char *msg = "Updating user application\r\n";
     INFO("%s", msg);
-    eCode = hal_send_to_host(msg, strlen(msg));
+    eCode = tx_queue_send(msg, strlen(msg));
     ERR_CHECK(eCode);
 
-    /* Remove the flag signalizing update */
-    p_boot_record->is_new_app_ready = false;
-
-    /* Erase user application sectors */
-    eCode = hal_flash_erase_sector(BOOT_ACT_APP_START_SECTOR,
-    BOOT_ACT_APP_MAX_SECTORS);
+#if 1 == CBL_AB_SLOTS
+    eCode = update_act_switch(p_boot_record);
+#else
+    eCode = update_act_copy(p_boot_record);
+#endif
     ERR_CHECK(eCode);
 
-    /* Write bytes to active application location */
-    eCode = update_act(p_boot_record->new_app.app_type, new_len);
+    /* Remove the flag signalizing update, application is in place already */
+    eCode = retained_flag_set(RETAINED_NEW_APP_READY, false);
     ERR_CHECK(eCode);
 
-    /* Update active application meta data */
-    p_boot_record->act_app.app_type = p_boot_record->new_app.app_type;
-    p_boot_record->act_app.cksum_used = p_boot_record->new_app.cksum_used;
-    p_boot_record->act_app.len = p_boot_record->new_app.len;
-
     eCode = boot_record_set(p_boot_record);
 
     return eCode;
 }
 
+#if 1 == CBL_AB_SLOTS
+/**
+ * @brief Starts application from the other slot on the next start. Meta data
+ *        of both slots are swapped, so the previous application can be rolled
+ *        back to the same way.
+ *
+ * @param p_boot_record[in,out] Boot record, written by the caller
+ */
+static cbl_err_code_t update_act_switch (boot_record_t * p_boot_record)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    app_meta_t prev_app = p_boot_record->act_app;
+    boot_slot_t slot = boot_record_get_new_slot();
+    char slot_info[16] = { 0 };
+
+    /* Erased MSP means nothing was written to the slot */
+    if (p_boot_record->new_app.app_type != TYPE_BIN
+            || 0 == p_boot_record->new_app.len
+            || *(volatile uint32_t *)BOOT_SLOT_START(slot) == FLASH_ERASED_WORD)
+    {
+        return CBL_ERR_SLOT_EMPTY;
+    }
+
+    p_boot_record->act_app = p_boot_record->new_app;
+    p_boot_record->new_app = prev_app;
+    p_boot_record->act_slot = slot;
+
+    /* Notify host which slot is started from now on */
+    snprintf(slot_info, sizeof(slot_info), "slot:%c\r\n",
+            (BOOT_SLOT_A == slot) ? 'A' : 'B');
+    INFO("%s", slot_info);
+    eCode = tx_queue_send(slot_info, strlen(slot_info));
+
+    return eCode;
+}
+#endif /* 1 == CBL_AB_SLOTS */
+
 /**
  * @brief Converts text of force parameter to boolean
  *
@@ -156,35 +199,82 @@ bool * p_force)
     return eCode;
 }
 
+#if 1 != CBL_AB_SLOTS
 /**
- * @brief Updates the flash bytes according to app_type
+ * @brief Copies new application to active application area, patch is applied
+ *        first
+ *
+ * @param p_boot_record[in,out] Boot record, written by the caller
+ */
+static cbl_err_code_t update_act_copy (boot_record_t * p_boot_record)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t new_addr = BOOT_NEW_APP_START;
+    uint32_t new_len = p_boot_record->new_app.len;
+    app_type_t new_type = p_boot_record->new_app.app_type;
+
+    if (TYPE_PATCH == new_type)
+    {
+        /* Patch is applied to active application, so new one is rebuilt
+         * before active application is erased */
+        eCode = update_act_patch(p_boot_record, &new_addr, &new_len);
+        ERR_CHECK(eCode);
+
+        new_type = TYPE_BIN;
+    }
+
+    /* Write bytes to active application location */
+    eCode = update_act(new_type, new_addr, new_len);
+    ERR_CHECK(eCode);
+
+    /* Update active application meta data */
+    p_boot_record->act_app.app_type = new_type;
+    p_boot_record->act_app.cksum_used = p_boot_record->new_app.cksum_used;
+    p_boot_record->act_app.len = new_len;
+
+    return eCode;
+}
+
+/**
+ * @brief Updates the flash bytes according to app_type. Binary application
+ *        erases only sectors that differ, others erase the whole area.
  *
  * @param app_type Application type used in new application
+ * @param new_addr Address of new binary application
  * @param new_len  Length of new application
  */
-static cbl_err_code_t update_act (app_type_t app_type, uint32_t new_len)
+static cbl_err_code_t update_act (app_type_t app_type, uint32_t new_addr,
+        uint32_t new_len)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
     switch (app_type)
     {
         case TYPE_BIN:
         {
-            eCode = update_act_bin(new_len);
+            eCode = update_act_bin(new_addr, new_len);
         }
         break;
 
         case TYPE_HEX:
         {
+            eCode = flash_erase(BOOT_ACT_APP_START, BOOT_ACT_APP_MAX_LEN);
+            ERR_CHECK(eCode);
+
             eCode = update_act_hex(new_len);
         }
         break;
 
         case TYPE_SREC:
         {
+            eCode = flash_erase(BOOT_ACT_APP_START, BOOT_ACT_APP_MAX_LEN);
+            ERR_CHECK(eCode);
+
             eCode = update_act_srec(new_len);
         }
         break;
 
+        case TYPE_PATCH:
+            /* Rebuilt to binary by update_act_patch */
         case TYPE_UNDEF:
         default:
         {
@@ -197,13 +287,23 @@ static cbl_err_code_t update_act (app_type_t app_type, uint32_t new_len)
 }
 
 /**
- * @brief Updates bytes of current application from binary new application
+ * @brief Updates bytes of current application from binary new application.
+ *        Only sectors the new application overlaps are visited. Sector is
+ *        erased only if it can't be programmed as it is, bytes that already
+ *        match are not programmed. Deploying the same or a similar
+ *        application saves time and flash endurance. Sectors after the new
+ *        application are left as they are, only 'act_app.len' bytes of the
+ *        area are the application.
  *
- * @param new_len Length of new application
+ * @param new_addr Address of new application
+ * @param new_len  Length of new application
  */
-static cbl_err_code_t update_act_bin (uint32_t new_len)
+static cbl_err_code_t update_act_bin (uint32_t new_addr, uint32_t new_len)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t offset = 0;
+    uint32_t skipped = 0;
+    char skip_info[32] = { 0 };
 
     if (new_len > BOOT_ACT_APP_MAX_LEN)
     {
@@ -211,8 +311,72 @@ static cbl_err_code_t update_act_bin (uint32_t new_len)
         return CBL_ERR_NEW_APP_LEN;
     }
 
-    eCode = hal_write_program_bytes(BOOT_ACT_APP_START,
-            (uint8_t *)BOOT_NEW_APP_START, new_len);
+    while (offset < new_len)
+    {
+        uint32_t addr = BOOT_ACT_APP_START + offset;
+        uint32_t sector_end = flash_get_sector_end(addr);
+        uint32_t len = ui32_min(new_len - offset, sector_end - addr);
+        uint8_t *p_src = (uint8_t *)(new_addr + offset);
+
+        /* Rest of old application in the last sector is erased too */
+        if (flash_compare(addr, p_src, len) == FLASH_CMP_ERASE
+                || flash_is_erased(addr + len, sector_end - addr - len)
+                        == false)
+        {
+            eCode = flash_erase(addr, len);
+            ERR_CHECK(eCode);
+        }
+
+        eCode = flash_program_diff(addr, p_src, len, &skipped);
+        ERR_CHECK(eCode);
+
+        offset += sector_end - addr;
+    }
+
+    /* Notify host how many bytes already matched */
+    snprintf(skip_info, sizeof(skip_info), "skipped:%lu\r\n", skipped);
+    INFO("%s", skip_info);
+    eCode = tx_queue_send(skip_info, strlen(skip_info));
+
+    return eCode;
+}
+
+/**
+ * @brief Rebuilds new application from active application and the patch in
+ *        new application area. It is rebuilt into new application sectors
+ *        following the patch and checked against the digest from boot record.
+ *
+ * @param p_boot_record[in] Boot record with patch length and digest
+ * @param p_new_addr[out]   Address of rebuilt binary application
+ * @param p_new_len[out]    Length of rebuilt binary application
+ */
+static cbl_err_code_t update_act_patch (boot_record_t * p_boot_record,
+        uint32_t * p_new_addr, uint32_t * p_new_len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t patch_len = p_boot_record->new_app.len;
+    uint32_t rebuild_start;
+    patch_hdr_t hdr;
+
+    eCode = patch_get_header(BOOT_NEW_APP_START, patch_len, &hdr);
+    ERR_CHECK(eCode);
+
+    rebuild_start = BOOT_PATCH_REBUILD_START(patch_len);
+    if (hdr.new_len > BOOT_NEW_APP_START + BOOT_NEW_APP_MAX_LEN
+            - rebuild_start)
+    {
+        return CBL_ERR_NEW_APP_LEN;
+    }
+
+    *p_new_addr = rebuild_start;
+    *p_new_len = hdr.new_len;
+
+    /* Only sectors the rebuilt application takes */
+    eCode = flash_erase(rebuild_start, hdr.new_len);
+    ERR_CHECK(eCode);
+
+    eCode = patch_apply(BOOT_NEW_APP_START, patch_len, BOOT_ACT_APP_START,
+            *p_new_addr, p_boot_record->new_app_digest);
 
     return eCode;
 }
@@ -735,4 +899,6 @@ static cbl_err_code_t srec_handle_fcn_3 (uint8_t byte_count,
     return eCode;
 }
 
+#endif /* 1 != CBL_AB_SLOTS */
+
 /*** end of file ***/
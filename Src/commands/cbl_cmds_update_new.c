@@ -4,6 +4,11 @@
  *        record
  */
 #include "etc/cbl_checksum.h"
+#include "etc/cbl_patch.h"
+#include "etc/cbl_journal.h"
+#include "etc/cbl_retained.h"
+#include "etc/cbl_flash.h"
+#include "etc/cbl_tx_queue.h"
 #include "commands/cbl_cmds_memory.h"
 #include "commands/cbl_cmds_update_new.h"
 #include <stdbool.h>
@@ -13,6 +18,11 @@
 
 static cbl_err_code_t update_new_get_params (parser_t * ph_prsr,
         uint32_t * p_len, cksum_t * p_cksum, app_type_t * p_app_type);
+static cbl_err_code_t update_new_get_resume (parser_t * ph_prsr,
+        bool * p_resume);
+static cbl_err_code_t update_new_resume (journal_xfer_t * p_xfer,
+        uint32_t * p_done, bool is_erase_first);
+static cbl_err_code_t update_new_discard (void);
 
 /**
  * @brief Updates new application bytes and writes to boot_record. On success
@@ -21,44 +31,106 @@ static cbl_err_code_t update_new_get_params (parser_t * ph_prsr,
  *          count - number of bytes to write
  *          cksum - checksum used
  *          type - application type (bin, hex...)
+ *          window - optional, number of chunks host streams ahead
+ *          runs - optional, number of runs of sparse transfer
+ *          resume - optional, continues interrupted transfer, other
+ *            parameters except window and chunk are taken from the journal
+ *          erase - optional, without it sectors are erased as chunks land in
+ *            them, so the first chunk is requested without waiting for the
+ *            whole area to be erased. Differential transfer without it
+ *            erases the application first.
  *
  * @param phPrsr Pointer to handle of parser
  */
 cbl_err_code_t cmd_update_new (parser_t * phPrsr)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
-    uint32_t len;
-    cksum_t cksum;
-    app_type_t app_type;
-    boot_record_t * p_boot_record;
+    journal_xfer_t xfer;
+    flash_write_opt_t opt;
+    bool resume = false;
+    bool is_erase_first = false;
 
-    eCode = update_new_get_params(phPrsr, &len, &cksum, &app_type);
+    eCode = update_new_get_resume(phPrsr, &resume);
     ERR_CHECK(eCode);
 
-    eCode = hal_flash_erase_sector(BOOT_NEW_APP_START_SECTOR,
-            BOOT_NEW_APP_MAX_SECTORS);
+    eCode = flash_write_get_opts(phPrsr, &opt);
     ERR_CHECK(eCode);
 
-    eCode = flash_write(BOOT_NEW_APP_START, len, cksum);
-    ERR_CHECK(eCode);
+    /* Erased sector would lose bytes that matched */
+    if (ERASE_DEFAULT == opt.erase)
+    {
+        is_erase_first = opt.is_diff;
+        opt.erase = opt.is_diff ? ERASE_NO : ERASE_AUTO;
+    }
 
-    p_boot_record = boot_record_get();
+    if (resume)
+    {
+        char resume_info[32] = { 0 };
 
-    p_boot_record->new_app.app_type = app_type;
-    p_boot_record->new_app.cksum_used = cksum;
-    p_boot_record->new_app.len = len;
+        /* Compressed and sparse transfers are not journaled */
+        if (opt.compress != COMPRESS_NO)
+        {
+            return CBL_ERR_COMPRESS;
+        }
 
-    p_boot_record->is_new_app_ready = true;
+        if (opt.runs != 0)
+        {
+            return CBL_ERR_SPARSE;
+        }
 
-    eCode = boot_record_set(p_boot_record);
+        eCode = update_new_resume( &xfer, &opt.done, is_erase_first);
+        ERR_CHECK(eCode);
+
+        opt.is_journal = true;
+
+        /* Notify host where to continue from */
+        snprintf(resume_info, sizeof(resume_info), "\r\nresume:%lu\r\n",
+                opt.done);
+        eCode = tx_queue_send(resume_info, strlen(resume_info));
+        ERR_CHECK(eCode);
+    }
+    else
+    {
+        eCode = update_new_get_params(phPrsr, &xfer.len, &xfer.cksum,
+                &xfer.app_type);
+        ERR_CHECK(eCode);
+
+        if (is_erase_first)
+        {
+            eCode = update_new_erase(xfer.len);
+        }
+        else
+        {
+            eCode = update_new_discard();
+        }
+        ERR_CHECK(eCode);
+
+        opt.is_journal = (COMPRESS_NO == opt.compress && 0 == opt.runs);
+
+        if (opt.is_journal)
+        {
+            eCode = journal_start( &xfer);
+            ERR_CHECK(eCode);
+        }
+    }
+
+    eCode = flash_write(BOOT_SLOT_START(boot_record_get_new_slot()), xfer.len,
+            xfer.cksum, &opt);
+    ERR_CHECK(eCode);
+
+    /* Also clears the journal */
+    eCode = update_new_set_ready(xfer.len, xfer.cksum, xfer.app_type);
     ERR_CHECK(eCode);
 
-    eCode = hal_send_to_host(TXT_SUCCESS, strlen(TXT_SUCCESS));
+    eCode = tx_queue_send(TXT_SUCCESS, strlen(TXT_SUCCESS));
     ERR_CHECK(eCode);
 
     char restart_msg[] = "Restarting...\r\n";
     INFO("%s", restart_msg);
-    eCode = hal_send_to_host(restart_msg, strlen(restart_msg));
+    eCode = tx_queue_send(restart_msg, strlen(restart_msg));
+    ERR_CHECK(eCode);
+
+    eCode = tx_queue_flush();
     ERR_CHECK(eCode);
 
     hal_system_restart();
@@ -67,6 +139,103 @@ cbl_err_code_t cmd_update_new (parser_t * phPrsr)
     return eCode;
 }
 
+/**
+ * @brief Erases sectors of new application area (with CBL_AB_SLOTS of the
+ *        slot application isn't started from) the new application will take.
+ *        Application that was there is not ready any more and its transfer
+ *        can't be resumed. Boot record is written only if it describes the
+ *        erased application, for rollback.
+ *
+ * @param len[in] Length of new application
+ */
+cbl_err_code_t update_new_erase (uint32_t len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    eCode = update_new_discard();
+    ERR_CHECK(eCode);
+
+    eCode = flash_erase(BOOT_SLOT_START(boot_record_get_new_slot()), len);
+
+    return eCode;
+}
+
+/**
+ * @brief Marks application written to new application area as ready, so it
+ *        is copied to active application area (with CBL_AB_SLOTS started from
+ *        its slot) on the next start. Digest of
+ *        the application rebuilt from a patch is taken from the patch.
+ *
+ * @param len[in]      Length of new application
+ * @param cksum[in]    Checksum used while transferring new application
+ * @param app_type[in] Application type
+ */
+cbl_err_code_t update_new_set_ready (uint32_t len, cksum_t cksum,
+        app_type_t app_type)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    boot_record_t * p_boot_record;
+
+    p_boot_record = boot_record_get();
+
+    if (TYPE_PATCH == app_type)
+    {
+        patch_hdr_t hdr;
+
+        eCode = patch_get_header(BOOT_NEW_APP_START, len, &hdr);
+        ERR_CHECK(eCode);
+
+        /* Rebuilt application shall fit after the patch */
+        if (hdr.old_len > BOOT_ACT_APP_MAX_LEN
+                || hdr.new_len > BOOT_ACT_APP_MAX_LEN
+                || hdr.new_len > BOOT_NEW_APP_START + BOOT_NEW_APP_MAX_LEN
+                        - BOOT_PATCH_REBUILD_START(len))
+        {
+            return CBL_ERR_NEW_APP_LEN;
+        }
+
+        memcpy(p_boot_record->new_app_digest, hdr.new_digest,
+                sizeof(p_boot_record->new_app_digest));
+    }
+
+    p_boot_record->new_app.app_type = app_type;
+    p_boot_record->new_app.cksum_used = cksum;
+    p_boot_record->new_app.len = len;
+
+    eCode = boot_record_set(p_boot_record);
+    ERR_CHECK(eCode);
+
+    /* Flag goes last, so it never points to older meta data */
+    return retained_flag_set(RETAINED_NEW_APP_READY, true);
+}
+
+/**
+ * @brief Checks if new application fits into new application area and if its
+ *        type can be used. With CBL_AB_SLOTS application is started from
+ *        where it is written, so only binary is accepted.
+ *
+ * @param len[in]      Length of new application
+ * @param app_type[in] Application type
+ */
+cbl_err_code_t update_new_check (uint32_t len, app_type_t app_type)
+{
+    if (len > BOOT_SLOT_MAX_LEN(boot_record_get_new_slot()))
+    {
+        return CBL_ERR_NEW_APP_LEN;
+    }
+
+#if 1 == CBL_AB_SLOTS
+    if (app_type != TYPE_BIN)
+#else
+    if (TYPE_UNDEF == app_type || app_type > TYPE_PATCH)
+#endif
+    {
+        return CBL_ERR_APP_TYPE;
+    }
+
+    return CBL_ERR_OK;
+}
+
 /**
  * @brief Gets the parameters for function update new application
  *
@@ -95,11 +264,6 @@ static cbl_err_code_t update_new_get_params (parser_t * ph_prsr,
     eCode = str2ui32(char_len, strlen(char_len), p_len, 10u);
     ERR_CHECK(eCode);
 
-    if (( *p_len) > BOOT_NEW_APP_MAX_LEN)
-    {
-        return CBL_ERR_NEW_APP_LEN;
-    }
-
     char_cksum = parser_get_val(ph_prsr, TXT_PAR_CKSUM, strlen(TXT_PAR_CKSUM));
 
     eCode = enum_checksum(char_cksum, strlen(char_cksum), p_cksum);
@@ -114,6 +278,124 @@ static cbl_err_code_t update_new_get_params (parser_t * ph_prsr,
     }
 
     eCode = enum_app_type(char_app_type, strlen(char_app_type), p_app_type);
+    ERR_CHECK(eCode);
+
+    return update_new_check( *p_len, *p_app_type);
+}
+
+/**
+ * @brief Gets optional resume parameter
+ *
+ * @param ph_prsr[in]  Pointer to parser with parameters
+ * @param p_resume[out] True if interrupted transfer shall be resumed
+ */
+static cbl_err_code_t update_new_get_resume (parser_t * ph_prsr,
+        bool * p_resume)
+{
+    char *char_resume = NULL;
+    uint32_t len;
+
+    char_resume = parser_get_val(ph_prsr, TXT_PAR_UP_NEW_RESUME,
+            strlen(TXT_PAR_UP_NEW_RESUME));
+    if (NULL == char_resume)
+    {
+        *p_resume = false;
+        return CBL_ERR_OK;
+    }
+
+    len = strlen(char_resume);
+
+    if (strlen(TXT_PAR_UP_NEW_TRUE) == len
+            && strncmp(char_resume, TXT_PAR_UP_NEW_TRUE, len) == 0)
+    {
+        *p_resume = true;
+    }
+    else if (strlen(TXT_PAR_UP_NEW_FALSE) == len
+            && strncmp(char_resume, TXT_PAR_UP_NEW_FALSE, len) == 0)
+    {
+        *p_resume = false;
+    }
+    else
+    {
+        return CBL_ERR_PAR_RESUME;
+    }
+
+    return CBL_ERR_OK;
+}
+
+/**
+ * @brief Gets interrupted transfer from the journal. Bytes after the recorded
+ *        progress up to the end of its sector shall be erased, later sectors
+ *        are erased as chunks land in them. If power was lost while writing
+ *        a chunk they are not, then the transfer continues from the start of
+ *        that sector, which flash_write erases again. If the application was
+ *        erased first, the rest of it is erased again here.
+ *
+ * @param p_xfer[out]        Parameters of interrupted transfer
+ * @param p_done[out]        Number of bytes already written
+ * @param is_erase_first[in] Application is erased before it is written
+ */
+static cbl_err_code_t update_new_resume (journal_xfer_t * p_xfer,
+        uint32_t * p_done, bool is_erase_first)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t start = BOOT_SLOT_START(boot_record_get_new_slot());
+    uint32_t pos;
+    uint32_t end;
+
+    eCode = journal_get(p_xfer, p_done);
+    ERR_CHECK(eCode);
+
+    pos = start + *p_done;
+    end = start + p_xfer->len;
+    if (false == is_erase_first)
+    {
+        end = ui32_min(flash_get_sector_end(pos), end);
+    }
+
+    if (pos >= end || flash_is_erased(pos, end - pos))
+    {
+        return eCode;
+    }
+
+    *p_done = flash_get_sector_info(flash_get_sector(pos))->start - start;
+
+    if (is_erase_first)
+    {
+        eCode = flash_erase(start + *p_done, p_xfer->len - *p_done);
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Application in new application area is not ready any more and its
+ *        transfer can't be resumed. Boot record is written only if it
+ *        describes that application, for rollback.
+ */
+static cbl_err_code_t update_new_discard (void)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    eCode = retained_flag_set(RETAINED_NEW_APP_READY, false);
+    ERR_CHECK(eCode);
+
+    eCode = journal_clear();
+    ERR_CHECK(eCode);
+
+#if 1 == CBL_AB_SLOTS
+    boot_record_t * p_boot_record = boot_record_get();
+
+    if (p_boot_record->new_app.len != 0)
+    {
+        /* Previous application can't be rolled back to any more */
+        p_boot_record->new_app.app_type = TYPE_UNDEF;
+        p_boot_record->new_app.len = 0;
+
+        eCode = boot_record_set(p_boot_record);
+        ERR_CHECK(eCode);
+    }
+#endif /* 1 == CBL_AB_SLOTS */
 
     return eCode;
 }
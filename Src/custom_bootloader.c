@@ -13,6 +13,10 @@
  *              - 7.1 m     - Boolean begins with is, e.g. isExample
  */
 #include "etc/cbl_common.h"
+#include "etc/cbl_rx_ring.h"
+#include "etc/cbl_tx_queue.h"
+#include "etc/cbl_retained.h"
+#include "etc/cbl_boot_record.h"
 #include "custom_bootloader.h"
 #include <stdbool.h>
 #include <stdio.h>
@@ -36,12 +40,16 @@
 #if 1 == USE_CMDS_TEMPLATE
 #include "commands/cbl_cmds_template.h"
 #endif
+#if 1 == USE_CMDS_BINARY
+#include "commands/cbl_cmds_binary.h"
+#endif
 
 #define CMD_BUF_SZ 128 /*!< Size of a new command buffer */
 
 #define TXT_CMD_VERSION "version"
 #define TXT_CMD_HELP "help"
 #define TXT_CMD_RESET "reset"
+#define TXT_CMD_CAPS "caps"
 
 typedef enum
 {
@@ -63,12 +71,17 @@ typedef enum
     CMD_DIS_WRITE_PROT,
     CMD_READ_SECT_PROT_STAT,
     CMD_MEM_READ,
+    CMD_MEM_HASH,
+    CMD_MEM_MAP,
     CMD_FLASH_WRITE,
     CMD_EXIT,
     CMD_TEMPLATE,
     CMD_RESET,
     CMD_UPDATE_NEW,
-    CMD_UPDATE_ACT
+    CMD_UPDATE_ACT,
+    CMD_BINARY,
+    CMD_CAPS,
+    CMD_SET_BAUD
 } cmd_t;
 
 static void shell_init (void);
@@ -82,6 +95,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode);
 static cbl_err_code_t cmd_version (parser_t * phPrsr);
 static cbl_err_code_t cmd_help (parser_t * phPrsr);
 static cbl_err_code_t cmd_reset (parser_t * phPrsr);
+static cbl_err_code_t cmd_caps (parser_t * phPrsr);
 
 // \f - new page
 
@@ -109,15 +123,35 @@ void CBL_periph_init(void)
 void CBL_run_system ()
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
+    retained_t ret;
+    bool is_enter_req;
     INFO("Custom bootloader started\r\n");
 
-    if (hal_blue_btn_state_get() == true)
+    /* Request of the application is served once */
+    retained_get( &ret);
+    is_enter_req = (ret.flags & RETAINED_ENTER_BL) != 0;
+    ret.flags &= ~RETAINED_ENTER_BL;
+    ret.boot_cnt++;
+    if (retained_set( &ret) != CBL_ERR_OK)
+    {
+        WARNING("Retained memory couldn't be written\r\n");
+    }
+    INFO("Boot count: %lu\r\n", ret.boot_cnt);
+
+    if (hal_blue_btn_state_get() == true && false == is_enter_req)
     {
         INFO("Blue button pressed...\r\n");
     }
     else
     {
-        INFO("Blue button not pressed...\r\n");
+        if (is_enter_req)
+        {
+            INFO("Bootloader requested by application...\r\n");
+        }
+        else
+        {
+            INFO("Blue button not pressed...\r\n");
+        }
         eCode = run_shell_system();
     }
 
@@ -180,10 +214,16 @@ static void shell_init (void)
     "          If confused type \"help\"          " CRLF
     "*********************************************" CRLF;
 
-    hal_send_to_host(bufWelcome, strlen(bufWelcome));
+    tx_queue_send(bufWelcome, strlen(bufWelcome));
 
     UNUSED( &hal_recv_from_host_stop);
 
+    /* Receive from the host continuously from now on */
+    if (rx_ring_start() != CBL_ERR_OK)
+    {
+        ERROR("Continuous receive couldn't be started\r\n");
+    }
+
     /* Bootloader started turn on red LED */
     hal_led_on(LED_POWER_ON);
 }
@@ -215,17 +255,26 @@ static void go_to_user_app (void)
 {
     void (*pUserAppResetHandler) (void);
     uint32_t addressRstHndl;
-    volatile uint32_t msp_value = *(volatile uint32_t *)CBL_ADDR_USERAPP;
+#if 1 == CBL_AB_SLOTS
+    /* Application is linked for the slot it is in */
+    uint32_t app_addr = BOOT_SLOT_START(boot_record_get_act_slot());
+#else
+    uint32_t app_addr = CBL_ADDR_USERAPP;
+#endif
+    volatile uint32_t msp_value = *(volatile uint32_t *)app_addr;
 
     char userAppHello[] = "Jumping to user application :)\r\n";
 
     /* Send hello message to user and debug output */
-    hal_send_to_host(userAppHello, strlen(userAppHello));
+    tx_queue_send(userAppHello, strlen(userAppHello));
     INFO("%s", userAppHello);
 
+    /* Transmission stops with deinit */
+    tx_queue_flush();
+
     hal_deinit();
 
-    addressRstHndl = *(volatile uint32_t *)(CBL_ADDR_USERAPP + 4u);
+    addressRstHndl = *(volatile uint32_t *)(app_addr + 4u);
 
     pUserAppResetHandler = (void *)addressRstHndl;
 
@@ -236,7 +285,7 @@ static void go_to_user_app (void)
     DEBUG("Reset handler address: %#x\r\n", (unsigned int ) addressRstHndl);
 
     /* Reconfigure the vector table location */
-    hal_vtor_set(CBL_ADDR_USERAPP);
+    hal_vtor_set(app_addr);
 
     hal_stop_systick();
 
@@ -317,7 +366,7 @@ static cbl_err_code_t run_shell_system (void)
                 char bye[] = "Exiting\r\n\r\n";
 
                 INFO(bye);
-                eCode = hal_send_to_host(bye, strlen(bye));
+                eCode = tx_queue_send(bye, strlen(bye));
                 ERR_CHECK(eCode);
 
                 isExitNeeded = true;
@@ -376,23 +425,18 @@ static cbl_err_code_t wait_for_cmd (char * buf, size_t len)
     bool isLastCharCR = false;
     bool isOverflow = true;
     uint32_t iii = 0u;
-    gRxCmdCntr = 0u;
 
-    eCode = hal_send_to_host("\r\n> ", 4);
+    eCode = tx_queue_send("\r\n> ", 4);
     ERR_CHECK(eCode);
 
-    /* Read until CRLF or until full DMA */
-    while (gRxCmdCntr < len)
+    /* Read until CRLF or until full buffer */
+    while (iii < len)
     {
-        /* Receive one char from host */
-        eCode = hal_recv_from_host_start((uint8_t *)buf + iii, 1);
+        /* Sleep until a char from host arrives, it may already be in RX
+         * ring */
+        eCode = rx_ring_recv((uint8_t *)buf + iii, 1, CBL_CMD_TIMEOUT_MS);
         ERR_CHECK(eCode);
 
-        while (iii != (gRxCmdCntr - 1))
-        {
-            /* Wait for a new char */
-        }
-
         if (true == isLastCharCR)
         {
             if ('\n' == buf[iii])
@@ -412,7 +456,7 @@ static cbl_err_code_t wait_for_cmd (char * buf, size_t len)
         /* Prepare for next char */
         iii++;
     }
-    /* If DMA fills the buffer and no CRLF is received throw an error */
+    /* If buffer fills and no CRLF is received throw an error */
     if (true == isOverflow)
     {
         eCode = CBL_ERR_READ_OF;
@@ -457,6 +501,11 @@ static cbl_err_code_t enum_cmd (char * buf, size_t len, cmd_t * pCmdCode)
     {
         *pCmdCode = CMD_RESET;
     }
+    else if (len == strlen(TXT_CMD_CAPS)
+            && strncmp(buf, TXT_CMD_CAPS, strlen(TXT_CMD_CAPS)) == 0)
+    {
+        *pCmdCode = CMD_CAPS;
+    }
 #ifdef CBL_CMDS_ETC_H
     else if (len == strlen(TXT_CMD_CID)
             && strncmp(buf, TXT_CMD_CID, strlen(TXT_CMD_CID)) == 0)
@@ -468,6 +517,11 @@ static cbl_err_code_t enum_cmd (char * buf, size_t len, cmd_t * pCmdCode)
     {
         *pCmdCode = CMD_EXIT;
     }
+    else if (len == strlen(TXT_CMD_SET_BAUD)
+            && strncmp(buf, TXT_CMD_SET_BAUD, strlen(TXT_CMD_SET_BAUD)) == 0)
+    {
+        *pCmdCode = CMD_SET_BAUD;
+    }
 #endif
 #ifdef CBL_CMDS_OPT_BYTES_H
     else if (len == strlen(TXT_CMD_GET_RDP_LVL)
@@ -513,6 +567,16 @@ static cbl_err_code_t enum_cmd (char * buf, size_t len, cmd_t * pCmdCode)
     {
         *pCmdCode = CMD_MEM_READ;
     }
+    else if (len == strlen(TXT_CMD_MEM_HASH)
+            && strncmp(buf, TXT_CMD_MEM_HASH, strlen(TXT_CMD_MEM_HASH)) == 0)
+    {
+        *pCmdCode = CMD_MEM_HASH;
+    }
+    else if (len == strlen(TXT_CMD_MEM_MAP)
+            && strncmp(buf, TXT_CMD_MEM_MAP, strlen(TXT_CMD_MEM_MAP)) == 0)
+    {
+        *pCmdCode = CMD_MEM_MAP;
+    }
     else if (len == strlen(TXT_CMD_FLASH_WRITE)
             && strncmp(buf, TXT_CMD_FLASH_WRITE, strlen(TXT_CMD_FLASH_WRITE))
                     == 0)
@@ -536,6 +600,13 @@ static cbl_err_code_t enum_cmd (char * buf, size_t len, cmd_t * pCmdCode)
         *pCmdCode = CMD_UPDATE_ACT;
     }
 #endif /* CBL_CMDS_UPDATE_ACT_H */
+#ifdef CBL_CMDS_BINARY_H
+    else if (len == strlen(TXT_CMD_BINARY)
+            && strncmp(buf, TXT_CMD_BINARY, strlen(TXT_CMD_BINARY)) == 0)
+    {
+        *pCmdCode = CMD_BINARY;
+    }
+#endif /* CBL_CMDS_BINARY_H */
 #ifdef CBL_CMDS_TEMPLATE_H
     /* Add a new enum value in cmd_t and check for it here */
     else if (len == strlen(TXT_CMD_TEMPLATE)
@@ -589,6 +660,12 @@ static cbl_err_code_t handle_cmd (cmd_t cmdCode, parser_t * phPrsr)
         }
         break;
 
+        case CMD_CAPS:
+        {
+            eCode = cmd_caps(phPrsr);
+        }
+        break;
+
 #ifdef CBL_CMDS_OPT_BYTES_H
         case CMD_GET_RDP_LVL:
         {
@@ -633,6 +710,18 @@ static cbl_err_code_t handle_cmd (cmd_t cmdCode, parser_t * phPrsr)
         }
         break;
 
+        case CMD_MEM_HASH:
+        {
+            eCode = cmd_mem_hash(phPrsr);
+        }
+        break;
+
+        case CMD_MEM_MAP:
+        {
+            eCode = cmd_mem_map(phPrsr);
+        }
+        break;
+
         case CMD_FLASH_WRITE:
         {
             eCode = cmd_flash_write(phPrsr);
@@ -653,6 +742,13 @@ static cbl_err_code_t handle_cmd (cmd_t cmdCode, parser_t * phPrsr)
         }
         break;
 #endif /* CBL_CMDS_UPDATE_ACT_H */
+#ifdef CBL_CMDS_BINARY_H
+        case CMD_BINARY:
+        {
+            eCode = cmd_binary(phPrsr);
+        }
+        break;
+#endif /* CBL_CMDS_BINARY_H */
 #ifdef CBL_CMDS_ETC_H
         case CMD_CID:
         {
@@ -665,6 +761,12 @@ static cbl_err_code_t handle_cmd (cmd_t cmdCode, parser_t * phPrsr)
             eCode = cmd_exit(phPrsr);
         }
         break;
+
+        case CMD_SET_BAUD:
+        {
+            eCode = cmd_set_baud(phPrsr);
+        }
+        break;
 #endif /* CBL_CMDS_ETC_H */
 #ifdef CBL_CMDS_TEMPLATE_H
             /* Add a new case for the enumerator and call function handler */
@@ -687,7 +789,7 @@ static cbl_err_code_t handle_cmd (cmd_t cmdCode, parser_t * phPrsr)
     if (eCode == CBL_ERR_OK)
     {
         /* Send success response */
-        eCode = hal_send_to_host(TXT_SUCCESS, strlen(TXT_SUCCESS));
+        eCode = tx_queue_send(TXT_SUCCESS, strlen(TXT_SUCCESS));
     }
 
     DEBUG("Responded\r\n");
@@ -719,7 +821,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
         {
             const char msg[] = "\r\nERROR: Command too long\r\n";
             WARNING("Overflow while reading happened\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -771,7 +873,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
         {
             const char msg[] = "\r\nERROR: Invalid command\r\n";
             INFO("Client sent an invalid command\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -780,7 +882,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
         {
             const char msg[] = "\r\nERROR: Missing parameter(s)\r\n";
             INFO("Command is missing parameter(s)\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -792,7 +894,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
                     "BKPSRAM, SYSMEM and EXTMEM (if connected)\r\n";
 
             INFO("Invalid address inputed for jumping\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -803,7 +905,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
                     "\r\nERROR: Internal error while erasing sectors\r\n";
 
             WARNING("Error while erasing sectors\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -813,7 +915,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
             const char msg[] = "\r\nERROR: Wrong sector given\r\n";
 
             INFO("Wrong sector given\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -823,7 +925,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
             const char msg[] = "\r\nERROR: Wrong sector count given\r\n";
 
             INFO("Wrong sector count given\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -833,7 +935,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
             const char msg[] = "\r\nERROR: Invalid address range entered\r\n";
 
             INFO("Invalid address range entered for writing\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -843,7 +945,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
             const char msg[] = "\r\nERROR: Invalid length\r\n";
 
             INFO("User entered length 0 or too big\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -854,7 +956,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
                     " Retry last message.\r\n";
 
             INFO("Error while writing to flash on HAL level\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -864,7 +966,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
             const char msg[] = "\r\nERROR: Invalid erase type\r\n";
 
             INFO("User entered invalid erase type\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -874,7 +976,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
             const char msg[] = "\r\nERROR: HAL error while erasing sectors \r\n";
 
             INFO("HAL error while erasing sector\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -884,7 +986,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
             const char msg[] = "\r\nERROR: Unlocking flash failed\r\n";
 
             WARNING("Unlocking flash with HAL failed\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -902,7 +1004,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
                     "\r\nERROR: Number parameter contains letters\r\n";
 
             WARNING("User entered number parameter containing letters\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -915,7 +1017,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
 
             WARNING("User entered number parameter with 'x', "
                     "but not '0' on index 0\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -926,7 +1028,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
                     " (Invalid checksum). Retry last message.\r\n";
 
             WARNING("Data corrupted during transport, invalid checksum\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -936,7 +1038,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
             const char msg[] = "\r\nERROR: Value for parameter invalid...\r\n";
 
             WARNING("User entered wrong param. value in template function\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -946,7 +1048,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
             const char msg[] = "\r\nERROR: Requested checksum not supported\r\n";
 
             WARNING("User requested checksum not supported\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -957,7 +1059,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
                     "divisible by 4 \r\n";
 
             WARNING("User entered invalid length for CRC32\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -967,7 +1069,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
             const char msg[] = "\r\nERROR: Invalid length for sha256\r\n";
 
             WARNING("User entered invalid length for sha256\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -978,7 +1080,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
 
             WARNING("New user application is too long"
                     "to for updating\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -989,7 +1091,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
                     "\r\nERROR: Requested action is not implemented\r\n";
 
             WARNING("Requested action is not implemented\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -999,7 +1101,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
             const char msg[] = "\r\nERROR: Invalid user application type\r\n";
 
             WARNING("Invalid user application type\r\n");
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -1011,7 +1113,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
 
             WARNING("NULL sent as a parameter of a function\r\n");
 
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -1022,7 +1124,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
 
             WARNING("Invalid force parameter\r\n");
 
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -1033,7 +1135,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
 
             WARNING("Invalid S-record file\r\n");
 
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -1044,7 +1146,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
 
             WARNING("Invalid S-record function\r\n");
 
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -1055,7 +1157,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
 
             WARNING("Invalid hex value character\r\n");
 
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -1066,7 +1168,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
 
             WARNING("Tried accessing forbidden address\r\n");
 
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -1077,7 +1179,7 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
 
             WARNING("Unsupported Intel hex function\r\n");
 
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -1088,7 +1190,315 @@ static cbl_err_code_t sys_state_error (cbl_err_code_t eCode)
 
             WARNING("Invalid contents of intel hex\r\n");
 
-            hal_send_to_host(msg, strlen(msg));
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_WINDOW:
+        {
+            const char msg[] = "\r\nERROR: Invalid window size. Maximum: "
+            TXT_FLASH_WRITE_MAX_WINDOW ", and window chunks shall fit into "
+            TXT_RX_RING_SZ " bytes\r\n";
+
+            WARNING("Invalid window size\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_CHUNK_SEQ:
+        {
+            const char msg[] = "\r\nERROR: Chunk received out of order."
+                    " Aborting\r\n";
+
+            WARNING("Chunk received out of order\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_FRAME_LEN:
+        {
+            const char msg[] = "\r\nERROR: Binary frame too long\r\n";
+
+            WARNING("Binary frame too long\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_FRAME_CRC:
+        {
+            const char msg[] = "\r\nERROR: Binary frame corrupted\r\n";
+
+            WARNING("Binary frame has invalid CRC\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_FRAME_OP:
+        {
+            const char msg[] = "\r\nERROR: Unknown binary opcode\r\n";
+
+            WARNING("Binary frame has unknown opcode\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_RX_OVERRUN:
+        {
+            const char msg[] = "\r\nERROR: Receive buffer overrun\r\n";
+
+            WARNING("Host sent more bytes than RX ring can hold\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_RX_TIMEOUT:
+        {
+            const char msg[] = "\r\nERROR: Timed out waiting for data\r\n";
+
+            WARNING("Host stopped sending in the middle of transfer\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_CHUNK_SZ:
+        {
+            const char msg[] = "\r\nERROR: Invalid chunk size\r\n";
+
+            WARNING("Chunk size is 0, too big or not divisible by 4\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_BAUD:
+        {
+            const char msg[] = "\r\nERROR: Baud rate not supported\r\n";
+
+            WARNING("UART doesn't support requested baud rate or flow "
+                    "control\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_BAUD_CONFIRM:
+        {
+            const char msg[] = "\r\nERROR: New baud rate not confirmed, "
+                    "old one restored\r\n";
+
+            WARNING("Host didn't confirm new baud rate\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_COMPRESS:
+        {
+            const char msg[] = "\r\nERROR: Unknown compression\r\n";
+
+            WARNING("Unknown compression requested\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_DECOMP:
+        {
+            const char msg[] = "\r\nERROR: Decompression failed\r\n";
+
+            WARNING("Compressed data is corrupted or of wrong length\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_INV_PATCH:
+        {
+            const char msg[] = "\r\nERROR: Invalid patch\r\n";
+
+            WARNING("Patch is malformed\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_PATCH_BASE:
+        {
+            const char msg[] =
+                    "\r\nERROR: Patch does not match active application\r\n";
+
+            WARNING("Active application differs from patch base\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_PATCH_DIGEST:
+        {
+            const char msg[] =
+                    "\r\nERROR: Patched application digest mismatch\r\n";
+
+            WARNING("Rebuilt application differs from the expected one\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_PAR_RESUME:
+        {
+            const char msg[] = "\r\nERROR: Invalid resume parameter\r\n";
+
+            WARNING("Invalid resume parameter\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_NO_JOURNAL:
+        {
+            const char msg[] = "\r\nERROR: Nothing to resume\r\n";
+
+            WARNING("No interrupted transfer in the journal\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_SPARSE:
+        {
+            const char msg[] = "\r\nERROR: Invalid sparse transfer\r\n";
+
+            WARNING("Invalid run table or options of sparse transfer\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_PAR_DIFF:
+        {
+            const char msg[] = "\r\nERROR: Invalid diff parameter\r\n";
+
+            WARNING("Invalid diff parameter\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_NOT_ERASED:
+        {
+            const char msg[] =
+                    "\r\nERROR: Flash differs and is not erased\r\n";
+
+            WARNING("Flash shall be erased before writing\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_READ_FRAME:
+        {
+            const char msg[] = "\r\nERROR: Invalid frame size, maximum is "
+            TXT_MEM_READ_MAX_FRAME "\r\n";
+
+            WARNING("Invalid frame size of streamed read\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_READ_RESEND:
+        {
+            const char msg[] = "\r\nERROR: Requested frame wasn't sent\r\n";
+
+            WARNING("Host asked for a frame outside of the read\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_HASH_LEN:
+        {
+            const char msg[] =
+                    "\r\nERROR: Count not a multiple of checksum's length "
+                    "multiple\r\n";
+
+            WARNING("Count not a multiple of checksum's length multiple\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_MAP_BLOCK:
+        {
+            const char msg[] = "\r\nERROR: Invalid block size\r\n";
+
+            WARNING("Block size is 0 or not a multiple of checksum\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_SLOT_EMPTY:
+        {
+            const char msg[] = "\r\nERROR: No application in other slot\r\n";
+
+            WARNING("Other slot holds no binary application\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_ERASE_RANGE:
+        {
+            const char msg[] = "\r\nERROR: Erase range outside of flash\r\n";
+
+            WARNING("Range to erase is not inside of flash\r\n");
+
+            tx_queue_send(msg, strlen(msg));
+            eCode = CBL_ERR_OK;
+        }
+        break;
+
+        case CBL_ERR_PAR_ERASE:
+        {
+            const char msg[] = "\r\nERROR: Invalid erase parameter\r\n";
+
+            WARNING("Invalid erase parameter or used with diff\r\n");
+
+            tx_queue_send(msg, strlen(msg));
             eCode = CBL_ERR_OK;
         }
         break;
@@ -1123,7 +1533,7 @@ static cbl_err_code_t cmd_version (parser_t * phPrsr)
     strlcat(verbuf, CRLF, 12);
 
     /* Send response */
-    eCode = hal_send_to_host(verbuf, strlen(verbuf));
+    eCode = tx_queue_send(verbuf, strlen(verbuf));
 
     return eCode;
 }
@@ -1151,6 +1561,8 @@ static cbl_err_code_t cmd_help (parser_t * phPrsr)
             "bootloader" CRLF CRLF
             "- " TXT_CMD_HELP " | Makes life easier" CRLF CRLF
             "- " TXT_CMD_RESET " | Resets the microcontroller" CRLF CRLF
+            "- " TXT_CMD_CAPS " | Gets capabilities of the bootloader, one "
+            "\"name:value\" per line" CRLF CRLF
 #ifdef CBL_CMDS_OPT_BYTES_H
             "- "
             TXT_CMD_GET_RDP_LVL
@@ -1194,25 +1606,69 @@ static cbl_err_code_t cmd_help (parser_t * phPrsr)
             "sectors" CRLF
             "          \"" TXT_PAR_FLASH_ERASE_TYPE_SECT "\" - erases only "
             "selected sectors" CRLF
+            "          \"" TXT_PAR_FLASH_ERASE_TYPE_RANGE "\" - erases "
+            "sectors the range of addresses overlaps" CRLF
             "    " TXT_PAR_FLASH_ERASE_SECT " - First sector to erase. "
-            "Bootloader is on sectors 0, 1 and 2. Not needed with mass erase."
-            CRLF "    " TXT_PAR_FLASH_ERASE_COUNT
-            " - Number of sectors to erase. Not needed with mass erase." CRLF
+            "Bootloader is on sectors 0, 1 and 2. Only with sector erase."
+            CRLF "    " TXT_PAR_FLASH_ERASE_START " - First address of the "
+            "range in hex format. Only with range erase." CRLF
+            "    " TXT_PAR_FLASH_ERASE_COUNT
+            " - Number of sectors to erase, with range erase number of bytes."
+            " Not needed with mass erase." CRLF
             CRLF "- " TXT_CMD_FLASH_WRITE " | Writes to flash byte by byte. "
             "Splits data into chunks" CRLF
             "     " TXT_PAR_FLASH_WRITE_START " - Starting address in hex "
             "format (e.g. 0x12345678), 0x can be omitted."CRLF
             "     " TXT_PAR_FLASH_WRITE_COUNT " - Number of bytes to write, "
-            "without checksum. Chunk size: " TXT_FLASH_WRITE_SZ CRLF
+            "without checksum." CRLF
+            "     [" TXT_PAR_FLASH_WRITE_CHUNK "] - Chunk size, divisible by 4."
+            " Default: " TXT_FLASH_WRITE_SZ ", maximum: "
+            TXT_FLASH_WRITE_MAX_SZ CRLF
+            "     [" TXT_PAR_FLASH_WRITE_COMPRESS "] - Compression of sent "
+            "bytes, checksum is of decompressed bytes" CRLF
+            "                \"" TXT_COMPRESS_LZ4 "\" - LZ4 frame, "
+            "needs \"" TXT_PAR_FLASH_WRITE_ZCOUNT "\"" CRLF
+            "                \"" TXT_COMPRESS_NO "\" - Not compressed, "
+            "default" CRLF
+            "     [" TXT_PAR_FLASH_WRITE_ZCOUNT "] - Number of compressed bytes "
+            "sent, chunks are made of them" CRLF
+            "     [" TXT_PAR_FLASH_WRITE_RUNS "] - Number of runs of sparse "
+            "transfer, maximum: " TXT_FLASH_WRITE_MAX_RUNS CRLF
+            "             Only runs are sent, other bytes are erased (0xFF)"
+            CRLF
+            "             Bytes between runs shall be erased, also with "
+            "\"" TXT_PAR_FLASH_WRITE_DIFF "\"" CRLF
+            "     [" TXT_PAR_FLASH_WRITE_DIFF "] - Bytes already in flash "
+            "are not programmed" CRLF
+            "                \"" TXT_PAR_FLASH_WRITE_TRUE "\" - Differential, "
+            "flash that differs shall be erased" CRLF
+            "                \"" TXT_PAR_FLASH_WRITE_FALSE "\" - Every byte "
+            "is programmed, default" CRLF
+            "     [" TXT_PAR_FLASH_WRITE_ERASE "] - Erasing of sectors"
+            CRLF
+            "                \"" TXT_PAR_FLASH_WRITE_ERASE_AUTO "\" - Sector "
+            "is erased when the first chunk lands in it, not with diff" CRLF
+            "                \"" TXT_PAR_FLASH_WRITE_ERASE_NO "\" - Sectors "
+            "shall be erased before, default" CRLF
+            "     [" TXT_PAR_FLASH_WRITE_WINDOW "] - Number of chunks host "
+            "sends without waiting for \"ack\". Maximum: "
+            TXT_FLASH_WRITE_MAX_WINDOW CRLF
+            "             If not present, every chunk waits for \"ready\""
+            CRLF
             "     [" TXT_PAR_CKSUM "] - Checksum to use. If not"
             " present, no checksum is assumed" CRLF
             "             WARNING: Even if checksum is wrong data "
             "will be written into flash memory!" CRLF
             "                \"" TXT_CKSUM_SHA256 "\" - Best protection, "
             "slowest" CRLF
+#if 1 == CBL_CRC32_SW
+            "                \"" TXT_CKSUM_CRC "\" - Medium protection, fast,"
+            " calculated in software." CRLF
+#else
             "                \"" TXT_CKSUM_CRC "\" - Medium protection, fast,"
             " uses inbuilt CRC32 hardware." CRLF
             "                   Note: Data length must be divisible by 4! " CRLF
+#endif /* 1 == CBL_CRC32_SW */
             "                   Settings:" CRLF
             "                            Polynomial: 0x4C11DB7 (Ethernet)" CRLF
             "                            Init value: 0xFFFFFFFF" CRLF
@@ -1229,8 +1685,46 @@ static cbl_err_code_t cmd_help (parser_t * phPrsr)
             "format (e.g. 0x12345678), 0x can be omitted."CRLF
             "     "
             TXT_PAR_FLASH_WRITE_COUNT
-            " - Number of bytes to read."
+            " - Number of bytes to read."CRLF
+            "     [" TXT_PAR_MEM_READ_FRAME "] - Streams bytes in checksummed "
+            "frames of this size, at most " TXT_MEM_READ_MAX_FRAME ". Frames "
+            "of 0x00 or 0xFF are sent as runs."
             CRLF CRLF
+            "- " TXT_CMD_MEM_HASH
+            " | Calculates checksum of memory and returns only it" CRLF
+            "     "
+            TXT_PAR_FLASH_WRITE_START
+            " - Starting address in hex "
+            "format (e.g. 0x12345678), 0x can be omitted."CRLF
+            "     "
+            TXT_PAR_FLASH_WRITE_COUNT
+            " - Number of bytes to hash."CRLF
+            "     " TXT_PAR_MEM_HASH_ALGO " - Checksum to calculate" CRLF
+            "                \"" TXT_CKSUM_SHA256 "\" - sha256" CRLF
+            "                \"" TXT_CKSUM_CRC "\" - CRC32 as in "
+            TXT_CMD_FLASH_WRITE
+#if 1 != CBL_CRC32_SW
+            ", count must be divisible by 4"
+#endif /* 1 != CBL_CRC32_SW */
+            CRLF
+            CRLF
+            "- " TXT_CMD_MEM_MAP
+            " | Returns checksum of every block of memory" CRLF
+            "     "
+            TXT_PAR_FLASH_WRITE_START
+            " - Starting address in hex "
+            "format (e.g. 0x12345678), 0x can be omitted."CRLF
+            "     "
+            TXT_PAR_FLASH_WRITE_COUNT
+            " - Number of bytes covered by the map."CRLF
+            "     [" TXT_PAR_MEM_MAP_BLOCK "] - Block size"
+#if 1 != CBL_CRC32_SW
+            ", divisible by 4 with " TXT_CKSUM_CRC
+#endif /* 1 != CBL_CRC32_SW */
+            ". Default: " TXT_MEM_MAP_BLOCK_SZ CRLF
+            "     [" TXT_PAR_MEM_HASH_ALGO "] - Checksum of blocks, as in "
+            TXT_CMD_MEM_HASH ". Default: " TXT_CKSUM_CRC CRLF
+            CRLF
 #endif /* CBL_CMDS_MEMORY_H */
 #ifdef CBL_CMDS_UPDATE_ACT_H
             "- " TXT_CMD_UPDATE_ACT " | Updates active application from new "
@@ -1253,15 +1747,58 @@ static cbl_err_code_t cmd_help (parser_t * phPrsr)
             "format (.hex)" CRLF
             "                \"" TXT_PAR_APP_TYPE_SREC "\" - Motorola S-record"
             " format (.srec)" CRLF
+            "                \"" TXT_PAR_APP_TYPE_PATCH "\" - Binary patch "
+            "of active application" CRLF
+            "     [" TXT_PAR_FLASH_WRITE_CHUNK "] - Chunk size, divisible by 4."
+            " Default: " TXT_FLASH_WRITE_SZ ", maximum: "
+            TXT_FLASH_WRITE_MAX_SZ CRLF
+            "     [" TXT_PAR_FLASH_WRITE_COMPRESS "] - Compression of sent "
+            "bytes, checksum is of decompressed bytes" CRLF
+            "                \"" TXT_COMPRESS_LZ4 "\" - LZ4 frame, "
+            "needs \"" TXT_PAR_FLASH_WRITE_ZCOUNT "\"" CRLF
+            "                \"" TXT_COMPRESS_NO "\" - Not compressed, "
+            "default" CRLF
+            "     [" TXT_PAR_FLASH_WRITE_ZCOUNT "] - Number of compressed bytes "
+            "sent, chunks are made of them" CRLF
+            "     [" TXT_PAR_FLASH_WRITE_RUNS "] - Number of runs of sparse "
+            "transfer, maximum: " TXT_FLASH_WRITE_MAX_RUNS CRLF
+            "             Only runs are sent, other bytes are erased (0xFF)"
+            CRLF
+            "             Bytes between runs shall be erased, also with "
+            "\"" TXT_PAR_FLASH_WRITE_DIFF "\"" CRLF
+            "     [" TXT_PAR_FLASH_WRITE_DIFF "] - Bytes already in flash "
+            "are not programmed" CRLF
+            "                \"" TXT_PAR_FLASH_WRITE_TRUE "\" - Differential, "
+            "flash that differs shall be erased" CRLF
+            "                \"" TXT_PAR_FLASH_WRITE_FALSE "\" - Every byte "
+            "is programmed, default" CRLF
+            "     [" TXT_PAR_FLASH_WRITE_ERASE "] - Erasing of sectors"
+            CRLF
+            "                \"" TXT_PAR_FLASH_WRITE_ERASE_AUTO "\" - Sector "
+            "is erased when the first chunk lands in it, default" CRLF
+            "                \"" TXT_PAR_FLASH_WRITE_ERASE_NO "\" - Sectors "
+            "shall be erased before" CRLF
+            "             With diff and no erase the application is erased "
+            "first" CRLF
+            "     [" TXT_PAR_FLASH_WRITE_WINDOW "] - Number of chunks host "
+            "sends without waiting for \"ack\". Maximum: "
+            TXT_FLASH_WRITE_MAX_WINDOW CRLF
+            "             If not present, every chunk waits for \"ready\""
+            CRLF
             "     [" TXT_PAR_CKSUM "] - Checksum to use. If not"
             " present, no checksum is assumed" CRLF
             "             WARNING: Even if checksum is wrong data "
             "will be written into flash memory!" CRLF
             "                \"" TXT_CKSUM_SHA256 "\" - Best protection, "
             "slowest" CRLF
+#if 1 == CBL_CRC32_SW
+            "                \"" TXT_CKSUM_CRC "\" - Medium protection, fast,"
+            " calculated in software." CRLF
+#else
             "                \"" TXT_CKSUM_CRC "\" - Medium protection, fast,"
             " uses inbuilt CRC32 hardware." CRLF
             "                   Note: Data length must be divisible by 4! " CRLF
+#endif /* 1 == CBL_CRC32_SW */
             "                   Settings:" CRLF
             "                            Polynomial: 0x4C11DB7 (Ethernet)" CRLF
             "                            Init value: 0xFFFFFFFF" CRLF
@@ -1269,7 +1806,13 @@ static cbl_err_code_t cmd_help (parser_t * phPrsr)
             "                                 RefIn: true" CRLF
             "                                RefOut: true" CRLF
             "                \"" TXT_CKSUM_NO "\" - No protection, fastest"
-            CRLF CRLF
+            CRLF
+            "     [" TXT_PAR_UP_NEW_RESUME "] - Continues interrupted "
+            "uncompressed transfer" CRLF
+            "                \"" TXT_PAR_UP_NEW_TRUE "\" - Other parameters "
+            "except window and chunk are not needed" CRLF
+            "                \"" TXT_PAR_UP_NEW_FALSE "\" - New transfer, "
+            "default" CRLF CRLF
 #endif /* CBL_CMDS_UPDATE_NEW_H */
 #ifdef CBL_CMDS_TEMPLATE_H
             /* Add a description of newly added command */
@@ -1281,24 +1824,77 @@ static cbl_err_code_t cmd_help (parser_t * phPrsr)
             TXT_PAR_TEMPLATE_VAL1
             CRLF CRLF
 #endif /* CBL_CMDS_TEMPLATE_H */
+#ifdef CBL_CMDS_BINARY_H
+            "- " TXT_CMD_BINARY_HELP " | Switches to binary framed protocol "
+            "for automated flashing, see README.md" CRLF CRLF
+#endif /* CBL_CMDS_BINARY_H */
 #ifdef CBL_CMDS_ETC_H
             "- " TXT_CMD_CID " | Gets chip identification number" CRLF CRLF
             "- "TXT_CMD_EXIT " | Exits the bootloader and starts the user "
             "application" CRLF CRLF
+            "- " TXT_CMD_SET_BAUD " | Switches UART to a new baud rate. "
+            "\"OK\" is sent at the old rate," CRLF
+            "     then host shall send \"" TXT_SET_BAUD_CONFIRM_HELP "\" at "
+            "the new rate, else the old rate is restored" CRLF
+            "     " TXT_PAR_SET_BAUD_RATE " - New baud rate" CRLF
+            "     [" TXT_PAR_SET_BAUD_FLOW "] - Flow control" CRLF
+            "                \"" TXT_PAR_SET_BAUD_FLOW_HW "\" - Hardware "
+            "flow control" CRLF
+            "                \"" TXT_PAR_SET_BAUD_FLOW_NO "\" - No flow "
+            "control, default" CRLF CRLF
 #endif /* CBL_CMDS_ETC_H */
             "********************************************************" CRLF
             "Examples are contained in README.md" CRLF
             "********************************************************" CRLF;
     DEBUG("Started\r\n");
     /* Send response */
-    eCode = hal_send_to_host(helpPrintout, strlen(helpPrintout));
+    eCode = tx_queue_send(helpPrintout, strlen(helpPrintout));
 
     return eCode;
 }
 
+/**
+ * @brief Returns capabilities of the bootloader to the host, so host tools can
+ *        tune the transfer to the link. One "name:value" per line, lists are
+ *        separated with ','
+ */
+static cbl_err_code_t cmd_caps (parser_t * phPrsr)
+{
+    const char caps[] =
+            "protocol:" CBL_PROTOCOL_VERSION CRLF
+            "rx-buf:" TXT_RX_RING_SZ CRLF
+#ifdef CBL_CMDS_MEMORY_H
+            "chunk:" TXT_FLASH_WRITE_SZ CRLF
+            "chunk-max:" TXT_FLASH_WRITE_MAX_SZ CRLF
+            "window-max:" TXT_FLASH_WRITE_MAX_WINDOW CRLF
+            "cksum:" TXT_CKSUM_LIST CRLF
+            "compress:" TXT_COMPRESS_LZ4 "," TXT_COMPRESS_NO CRLF
+            "runs-max:" TXT_FLASH_WRITE_MAX_RUNS CRLF
+            "erase:" TXT_PAR_FLASH_WRITE_ERASE_AUTO ","
+            TXT_PAR_FLASH_WRITE_ERASE_NO CRLF
+            "read-frame-max:" TXT_MEM_READ_MAX_FRAME CRLF
+#endif /* CBL_CMDS_MEMORY_H */
+#ifdef CBL_CMDS_UPDATE_NEW_H
+#if 1 == CBL_AB_SLOTS
+            "app-type:" TXT_PAR_APP_TYPE_BIN CRLF
+            "slots:2" CRLF
+#else
+            "app-type:" TXT_PAR_APP_TYPE_BIN "," TXT_PAR_APP_TYPE_HEX ","
+            TXT_PAR_APP_TYPE_SREC "," TXT_PAR_APP_TYPE_PATCH CRLF
+            "slots:1" CRLF
+#endif /* 1 == CBL_AB_SLOTS */
+#endif /* CBL_CMDS_UPDATE_NEW_H */
+            ;
+
+    DEBUG("Started\r\n");
+
+    return tx_queue_send(caps, strlen(caps));
+}
+
 static cbl_err_code_t cmd_reset (parser_t * phPrsr)
 {
-    hal_send_to_host(TXT_SUCCESS, strlen(TXT_SUCCESS));
+    tx_queue_send(TXT_SUCCESS, strlen(TXT_SUCCESS));
+    tx_queue_flush();
 
     hal_system_restart();
 
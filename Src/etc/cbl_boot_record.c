@@ -4,21 +4,39 @@
  *        and of a new one, if it is available
  *
  * @note This file is part of custom bootloader, but is also included in the
- *       user application
+ *       user application, with cbl_retained.c
  */
 #include "etc/cbl_boot_record.h"
 #include "commands/cbl_cmds_memory.h"
+#include "etc/cbl_crc32.h"
+#include "etc/cbl_flash.h"
+#include "etc/cbl_retained.h"
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define GOOD_KEY 0x12345678
+#define BOOT_RECORD_ENTRIES (BOOT_RECORD_LOG_SZ / sizeof(boot_record_entry_t))
 
-static volatile boot_record_t boot_record __attribute__((section(".appbr")));
+typedef struct
+{
+    uint32_t seq; /*!< Grows by one with every entry, programmed first */
+    uint32_t crc; /*!< CRC32 of 'seq' and 'rec' */
+    boot_record_t rec;
+} boot_record_entry_t;
+
+static volatile boot_record_entry_t boot_record_log[BOOT_RECORD_ENTRIES]
+__attribute__((section(".appbr")));
 static boot_record_t boot_record_editable;
 
 static void boot_record_init (boot_record_t * p_boot_record);
+static void boot_record_find (uint32_t * p_newest, uint32_t * p_next);
+static cbl_err_code_t boot_record_write (uint32_t idx, uint32_t seq,
+        const boot_record_t * p_rec);
+static uint32_t boot_record_crc (uint32_t seq, const uint8_t * buf,
+        uint32_t len);
+static cbl_err_code_t boot_record_keep_slot (const boot_record_t * p_rec);
 /**
  * @brief Gets a editable copy of boot record
  *
@@ -26,10 +44,15 @@ static void boot_record_init (boot_record_t * p_boot_record);
  */
 boot_record_t * boot_record_get (void)
 {
-    if (boot_record.key == GOOD_KEY)
+    uint32_t newest;
+    uint32_t next;
+
+    boot_record_find( &newest, &next);
+
+    if (newest < BOOT_RECORD_ENTRIES)
     {
-        memcpy( &boot_record_editable, (void *) &boot_record,
-                sizeof(boot_record));
+        memcpy( &boot_record_editable, (void *) &boot_record_log[newest].rec,
+                sizeof(boot_record_editable));
     }
     else
     {
@@ -41,23 +64,138 @@ boot_record_t * boot_record_get (void)
 }
 
 /**
- * @brief Sets the boot record value
+ * @brief Sets the boot record value. It is appended to the log, sector is
+ *        erased only if the log is full.
  *
  * @param new_bl_record Value to be written
  */
 cbl_err_code_t boot_record_set (boot_record_t * p_new_boot_record)
 {
     cbl_err_code_t eCode = CBL_ERR_OK;
-    uint32_t len = (uint32_t)sizeof(boot_record_t);
-    uint8_t *p_new_byte = (uint8_t *)p_new_boot_record;
+    uint32_t newest;
+    uint32_t next;
+    uint32_t seq = 0;
+    bool is_erase;
+
+    p_new_boot_record->key = GOOD_KEY;
+
+    boot_record_find( &newest, &next);
+
+    if (newest < BOOT_RECORD_ENTRIES)
+    {
+        seq = boot_record_log[newest].seq + 1;
 
-    p_new_boot_record->key = 0x12345678;
+        /* Log is full or next entry is not erased, as in sector of other
+         * format */
+        is_erase = (next >= BOOT_RECORD_ENTRIES)
+                || (flash_is_erased(BOOT_RECORD_START
+                        + next * sizeof(boot_record_entry_t),
+                        sizeof(boot_record_entry_t)) == false);
+    }
+    else
+    {
+        /* Sector of other format or with old journals, their sequence
+         * number could match the new one */
+        is_erase = (flash_is_erased(BOOT_RECORD_START, BOOT_RECORD_SECTOR_SZ)
+                == false);
+    }
 
-    eCode = hal_flash_erase_sector(BOOT_RECORD_SECTOR, BOOT_RECORD_MAX_SECTORS);
+    eCode = boot_record_keep_slot(p_new_boot_record);
     ERR_CHECK(eCode);
 
-    eCode = hal_write_program_bytes(BOOT_RECORD_START, p_new_byte, len);
-    return eCode;
+    if (is_erase)
+    {
+        eCode = flash_erase(BOOT_RECORD_START, BOOT_RECORD_SECTOR_SZ);
+        ERR_CHECK(eCode);
+
+        next = 0;
+    }
+
+    return boot_record_write(next, seq, p_new_boot_record);
+}
+
+/**
+ * @brief Returns the sequence number of the boot record, journal belongs to
+ *        the boot record it was started with
+ *
+ * @return Sequence number, BOOT_RECORD_NO_SEQ if there is no boot record
+ */
+uint32_t boot_record_get_seq (void)
+{
+    uint32_t newest;
+    uint32_t next;
+
+    boot_record_find( &newest, &next);
+
+    if (newest >= BOOT_RECORD_ENTRIES)
+    {
+        return BOOT_RECORD_NO_SEQ;
+    }
+
+    return boot_record_log[newest].seq;
+}
+
+/**
+ * @brief Erases the sector and writes the boot record back as the first entry
+ *        with the same sequence number. Used when journal runs out of space.
+ */
+cbl_err_code_t boot_record_compact (void)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t seq;
+    boot_record_t * p_boot_record;
+
+    p_boot_record = boot_record_get();
+    seq = boot_record_get_seq();
+
+    eCode = boot_record_keep_slot(p_boot_record);
+    ERR_CHECK(eCode);
+
+    eCode = flash_erase(BOOT_RECORD_START, BOOT_RECORD_SECTOR_SZ);
+    ERR_CHECK(eCode);
+
+    return boot_record_write(0, seq, p_boot_record);
+}
+
+/**
+ * @brief Returns the slot application is started from. Boot record is read
+ *        directly, editable copy is left as it is. Without boot record, as
+ *        after erase of interrupted compaction, copy in retained memory is
+ *        used.
+ */
+boot_slot_t boot_record_get_act_slot (void)
+{
+#if 1 == CBL_AB_SLOTS
+    uint32_t newest;
+    uint32_t next;
+    retained_t ret;
+
+    boot_record_find( &newest, &next);
+
+    if (newest < BOOT_RECORD_ENTRIES)
+    {
+        return (BOOT_SLOT_B == boot_record_log[newest].rec.act_slot) ?
+                BOOT_SLOT_B : BOOT_SLOT_A;
+    }
+
+    retained_get( &ret);
+
+    if (BOOT_SLOT_B == ret.act_slot)
+    {
+        return BOOT_SLOT_B;
+    }
+#endif /* 1 == CBL_AB_SLOTS */
+
+    return BOOT_SLOT_A;
+}
+
+/**
+ * @brief Returns the slot new application is written to
+ */
+boot_slot_t boot_record_get_new_slot (void)
+{
+    return (BOOT_SLOT_A == boot_record_get_act_slot()) ?
+            BOOT_SLOT_B : BOOT_SLOT_A;
 }
 
 /**
@@ -91,6 +229,11 @@ cbl_err_code_t enum_app_type (char *char_app_type, uint32_t len,
     {
         *p_app_type = TYPE_SREC;
     }
+    else if (strlen(TXT_PAR_APP_TYPE_PATCH) == len
+            && strncmp(char_app_type, TXT_PAR_APP_TYPE_PATCH, len) == 0)
+    {
+        *p_app_type = TYPE_PATCH;
+    }
     else
     {
         *p_app_type = TYPE_UNDEF;
@@ -113,9 +256,114 @@ static void boot_record_init (boot_record_t * p_boot_record)
     p_boot_record->new_app.app_type = TYPE_UNDEF;
     p_boot_record->new_app.cksum_used = CKSUM_UNDEF;
     p_boot_record->new_app.len = 0;
+    memset(p_boot_record->new_app_digest, 0,
+            sizeof(p_boot_record->new_app_digest));
+
+    p_boot_record->act_slot = boot_record_get_act_slot();
 
     p_boot_record->key = GOOD_KEY;
     p_boot_record->is_new_app_ready = false;
 }
 
+/**
+ * @brief Scans the log for the newest entry with correct CRC32, only sequence
+ *        numbers are read until it is found
+ *
+ * @param p_newest[out] Index of the newest entry, BOOT_RECORD_ENTRIES if
+ *                      there is none
+ * @param p_next[out]   Index of the first entry never written,
+ *                      BOOT_RECORD_ENTRIES if log is full
+ */
+static void boot_record_find (uint32_t * p_newest, uint32_t * p_next)
+{
+    uint32_t idx = 0;
+
+    while (idx < BOOT_RECORD_ENTRIES
+            && boot_record_log[idx].seq != FLASH_ERASED_WORD)
+    {
+        idx++;
+    }
+    *p_next = idx;
+
+    /* Entry torn by power loss is skipped */
+    while (idx-- > 0)
+    {
+        if (boot_record_log[idx].crc
+                == boot_record_crc(boot_record_log[idx].seq,
+                        (const uint8_t *) &boot_record_log[idx].rec,
+                        sizeof(boot_record_t)))
+        {
+            *p_newest = idx;
+            return;
+        }
+    }
+
+    *p_newest = BOOT_RECORD_ENTRIES;
+}
+
+/**
+ * @brief Programs log entry, sequence number goes first so interrupted write
+ *        leaves an entry that is skipped
+ *
+ * @param idx[in]   Index of erased entry
+ * @param seq[in]   Sequence number
+ * @param p_rec[in] Boot record
+ */
+static cbl_err_code_t boot_record_write (uint32_t idx, uint32_t seq,
+        const boot_record_t * p_rec)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t addr = BOOT_RECORD_START + idx * sizeof(boot_record_entry_t);
+    uint32_t crc = boot_record_crc(seq, (const uint8_t *)p_rec,
+            sizeof( *p_rec));
+
+    eCode = hal_write_program_bytes(addr, (uint8_t *) &seq, sizeof(seq));
+    ERR_CHECK(eCode);
+
+    eCode = hal_write_program_bytes(addr + 8, (uint8_t *)p_rec,
+            sizeof( *p_rec));
+    ERR_CHECK(eCode);
+
+    eCode = hal_write_program_bytes(addr + 4, (uint8_t *) &crc, sizeof(crc));
+
+    return eCode;
+}
+
+/**
+ * @brief Calculates CRC32 of sequence number and bytes
+ */
+static uint32_t boot_record_crc (uint32_t seq, const uint8_t * buf,
+        uint32_t len)
+{
+    uint32_t crc = crc32_calc(0, &seq, sizeof(seq));
+
+    return crc32_calc(crc, buf, len);
+}
+
+/**
+ * @brief Copies slot application is started from to retained memory before
+ *        the sector may be erased, so power loss before the boot record is
+ *        written back doesn't start the other slot
+ *
+ * @param p_rec[in] Boot record to be written
+ */
+static cbl_err_code_t boot_record_keep_slot (const boot_record_t * p_rec)
+{
+#if 1 == CBL_AB_SLOTS
+    retained_t ret;
+
+    retained_get( &ret);
+
+    if (ret.act_slot != (uint32_t)p_rec->act_slot)
+    {
+        ret.act_slot = (uint32_t)p_rec->act_slot;
+        return retained_set( &ret);
+    }
+#else
+    UNUSED(p_rec);
+#endif /* 1 == CBL_AB_SLOTS */
+
+    return CBL_ERR_OK;
+}
+
 /*** end of file ***/
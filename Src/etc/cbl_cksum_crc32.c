@@ -0,0 +1,275 @@
+/** @file cbl_cksum_crc32.c
+ *
+ * @brief CRC32 checksum provider, calculated with the CRC peripheral or in
+ *        software (CBL_CRC32_SW)
+ *                      CRC parameters:
+ *                          Polynomial length: 32
+ *                          CRC-32 polynomial: 0x4C11DB7 (Ethernet)
+ *                                 Init value: 0xFFFFFFFF
+ *                                     XOROut: true
+ *                                      RefIn: true
+ *                                     RefOut: true
+ */
+#include "etc/cbl_checksum.h"
+#if 1 == CBL_CKSUM_USE_CRC32
+#if 1 != CBL_CRC32_SW
+#include <crc.h>
+#endif
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+#define CHECKSUM_HAS_RBIT 1 /*!< Core reverses bits with RBIT instruction */
+#else
+#define CHECKSUM_HAS_RBIT 0
+#endif
+
+static void crc32_init (cksum_ctx_t * p_ctx);
+static cbl_err_code_t crc32_update (cksum_ctx_t * p_ctx, const uint8_t * buf,
+        uint32_t len);
+static void crc32_final (cksum_ctx_t * p_ctx, uint8_t * p_digest);
+#if 1 == CBL_CRC32_SW
+static void crc32_sw_init (cksum_ctx_t * p_ctx);
+
+/** Slice-by-8 tables of reflected polynomial 0xEDB88320, built on the first
+ *  use. Table 'k' advances CRC of a byte over 'k' following zero bytes. */
+static uint32_t crc32_sw_table[8][256];
+static bool crc32_sw_is_table = false;
+#else
+#define CRC32_HW_BLOCK_WORDS 64u /*!< Words passed to the CRC peripheral at
+                                      once */
+
+static uint32_t reflect_ui32 (uint32_t number);
+
+/** Reflected words waiting for the CRC peripheral */
+static uint32_t crc32_hw_block[CRC32_HW_BLOCK_WORDS];
+
+#if 1 != CHECKSUM_HAS_RBIT
+static const uint8_t reflect_byte_table[] = { 0x00, 0x80, 0x40, 0xC0, 0x20,
+        0xA0, 0x60, 0xE0, 0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0, 0x08,
+        0x88, 0x48, 0xC8, 0x28, 0xA8, 0x68, 0xE8, 0x18, 0x98, 0x58, 0xD8, 0x38,
+        0xB8, 0x78, 0xF8, 0x04, 0x84, 0x44, 0xC4, 0x24, 0xA4, 0x64, 0xE4, 0x14,
+        0x94, 0x54, 0xD4, 0x34, 0xB4, 0x74, 0xF4, 0x0C, 0x8C, 0x4C, 0xCC, 0x2C,
+        0xAC, 0x6C, 0xEC, 0x1C, 0x9C, 0x5C, 0xDC, 0x3C, 0xBC, 0x7C, 0xFC, 0x02,
+        0x82, 0x42, 0xC2, 0x22, 0xA2, 0x62, 0xE2, 0x12, 0x92, 0x52, 0xD2, 0x32,
+        0xB2, 0x72, 0xF2, 0x0A, 0x8A, 0x4A, 0xCA, 0x2A, 0xAA, 0x6A, 0xEA, 0x1A,
+        0x9A, 0x5A, 0xDA, 0x3A, 0xBA, 0x7A, 0xFA, 0x06, 0x86, 0x46, 0xC6, 0x26,
+        0xA6, 0x66, 0xE6, 0x16, 0x96, 0x56, 0xD6, 0x36, 0xB6, 0x76, 0xF6, 0x0E,
+        0x8E, 0x4E, 0xCE, 0x2E, 0xAE, 0x6E, 0xEE, 0x1E, 0x9E, 0x5E, 0xDE, 0x3E,
+        0xBE, 0x7E, 0xFE, 0x01, 0x81, 0x41, 0xC1, 0x21, 0xA1, 0x61, 0xE1, 0x11,
+        0x91, 0x51, 0xD1, 0x31, 0xB1, 0x71, 0xF1, 0x09, 0x89, 0x49, 0xC9, 0x29,
+        0xA9, 0x69, 0xE9, 0x19, 0x99, 0x59, 0xD9, 0x39, 0xB9, 0x79, 0xF9, 0x05,
+        0x85, 0x45, 0xC5, 0x25, 0xA5, 0x65, 0xE5, 0x15, 0x95, 0x55, 0xD5, 0x35,
+        0xB5, 0x75, 0xF5, 0x0D, 0x8D, 0x4D, 0xCD, 0x2D, 0xAD, 0x6D, 0xED, 0x1D,
+        0x9D, 0x5D, 0xDD, 0x3D, 0xBD, 0x7D, 0xFD, 0x03, 0x83, 0x43, 0xC3, 0x23,
+        0xA3, 0x63, 0xE3, 0x13, 0x93, 0x53, 0xD3, 0x33, 0xB3, 0x73, 0xF3, 0x0B,
+        0x8B, 0x4B, 0xCB, 0x2B, 0xAB, 0x6B, 0xEB, 0x1B, 0x9B, 0x5B, 0xDB, 0x3B,
+        0xBB, 0x7B, 0xFB, 0x07, 0x87, 0x47, 0xC7, 0x27, 0xA7, 0x67, 0xE7, 0x17,
+        0x97, 0x57, 0xD7, 0x37, 0xB7, 0x77, 0xF7, 0x0F, 0x8F, 0x4F, 0xCF, 0x2F,
+        0xAF, 0x6F, 0xEF, 0x1F, 0x9F, 0x5F, 0xDF, 0x3F, 0xBF, 0x7F, 0xFF };
+#endif /* 1 != CHECKSUM_HAS_RBIT */
+#endif /* 1 == CBL_CRC32_SW */
+
+const cksum_provider_t cksum_crc32 =
+{
+    .id = CKSUM_CRC32,
+    .name = TXT_CKSUM_CRC,
+    .digest_len = 4u,
+    .len_multiple = CRC32_LEN_MULTIPLE,
+    .init = crc32_init,
+    .update = crc32_update,
+    .final = crc32_final
+};
+
+/**
+ * @brief Resets CRC32 to the init value (0xFFFFFFFF)
+ */
+static void crc32_init (cksum_ctx_t * p_ctx)
+{
+#if 1 == CBL_CRC32_SW
+    crc32_sw_init(p_ctx);
+#else
+    __HAL_CRC_DR_RESET( &hcrc);
+#endif
+}
+
+/**
+ * @brief Accumulates bytes from 'buf' for CRC32
+ *
+ * @note Assumes memory is in little endian!
+ * @note With the CRC peripheral input data length must be divisible by 4! So
+ *       no leading zeroes are added. Software CRC32 (CBL_CRC32_SW) takes any
+ *       length and alignment.
+ *
+ * @param p_ctx[in,out] Context, used only by software CRC32
+ * @param buf[in]       Bytes to accumulate
+ * @param len[in]       Length of 'buf'
+ */
+static cbl_err_code_t crc32_update (cksum_ctx_t * p_ctx, const uint8_t * buf,
+        uint32_t len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+#if 1 == CBL_CRC32_SW
+    uint32_t crc = p_ctx->crc32;
+    uint32_t one;
+    uint32_t two;
+
+    /* Bytes up to the first aligned word */
+    while (len > 0 && ((uint32_t)buf & 3u) != 0)
+    {
+        crc = crc32_sw_table[0][(crc ^ *buf) & 0xFF] ^ (crc >> 8);
+        buf++;
+        len--;
+    }
+
+    /* Eight bytes per step, 'buf' is aligned */
+    while (len >= 8)
+    {
+        one = *(const uint32_t *)buf ^ crc;
+        two = *(const uint32_t *) &buf[4];
+
+        crc = crc32_sw_table[7][one & 0xFF]
+                ^ crc32_sw_table[6][(one >> 8) & 0xFF]
+                ^ crc32_sw_table[5][(one >> 16) & 0xFF]
+                ^ crc32_sw_table[4][one >> 24]
+                ^ crc32_sw_table[3][two & 0xFF]
+                ^ crc32_sw_table[2][(two >> 8) & 0xFF]
+                ^ crc32_sw_table[1][(two >> 16) & 0xFF]
+                ^ crc32_sw_table[0][two >> 24];
+
+        buf += 8;
+        len -= 8;
+    }
+
+    /* Remaining bytes */
+    while (len > 0)
+    {
+        crc = crc32_sw_table[0][(crc ^ *buf) & 0xFF] ^ (crc >> 8);
+        buf++;
+        len--;
+    }
+
+    p_ctx->crc32 = crc;
+#else
+    uint32_t n_words;
+
+    /* For crc32 data must be divisible by 4 */
+    if ((len % 4) != 0)
+    {
+        return CBL_ERR_CKSUM_WRONG;
+    }
+
+    /* Words are reflected in blocks, peripheral takes the whole block in one
+     * call */
+    while (len > 0)
+    {
+        n_words = len / 4;
+        if (n_words > CRC32_HW_BLOCK_WORDS)
+        {
+            n_words = CRC32_HW_BLOCK_WORDS;
+        }
+
+        for (uint32_t iii = 0; iii < n_words; iii++)
+        {
+            /* Make big endian and reflect bytes */
+            crc32_hw_block[iii] = reflect_ui32(
+                    *(const uint32_t *) &buf[4 * iii]);
+        }
+
+        HAL_CRC_Accumulate( &hcrc, crc32_hw_block, n_words);
+
+        buf += 4 * n_words;
+        len -= 4 * n_words;
+    }
+#endif /* 1 == CBL_CRC32_SW */
+
+    return eCode;
+}
+
+/**
+ * @brief Finishes CRC32 with output reflection and XOROut, writes it as big
+ *        endian as host sends it
+ */
+static void crc32_final (cksum_ctx_t * p_ctx, uint8_t * p_digest)
+{
+#if 1 == CBL_CRC32_SW
+    /* Software CRC32 is reflected already */
+    uint32_t crc = p_ctx->crc32;
+#else
+    /* Reflect calculated CRC */
+    uint32_t crc = reflect_ui32(hcrc.Instance->DR);
+#endif
+
+    /* XOROut */
+    crc ^= 0xFFFFFFFF;
+
+    p_digest[0] = (uint8_t)(crc >> 24);
+    p_digest[1] = (uint8_t)(crc >> 16);
+    p_digest[2] = (uint8_t)(crc >> 8);
+    p_digest[3] = (uint8_t)crc;
+}
+
+#if 1 == CBL_CRC32_SW
+/**
+ * @brief Resets software CRC32 to the init value, builds the tables first
+ *        time it is called
+ */
+static void crc32_sw_init (cksum_ctx_t * p_ctx)
+{
+    uint32_t crc;
+
+    p_ctx->crc32 = 0xFFFFFFFF;
+
+    if (true == crc32_sw_is_table)
+    {
+        return;
+    }
+
+    for (uint32_t iii = 0; iii < 256; iii++)
+    {
+        crc = iii;
+        for (uint32_t bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ ((crc & 1u) ? 0xEDB88320UL : 0);
+        }
+        crc32_sw_table[0][iii] = crc;
+    }
+
+    for (uint32_t iii = 0; iii < 256; iii++)
+    {
+        for (uint32_t slice = 1; slice < 8; slice++)
+        {
+            crc = crc32_sw_table[slice - 1][iii];
+            crc32_sw_table[slice][iii] = (crc >> 8)
+                    ^ crc32_sw_table[0][crc & 0xFF];
+        }
+    }
+
+    crc32_sw_is_table = true;
+}
+#else
+/**
+ * @brief Reflects uint32 around center. Essentially converts integer from
+ *        little endian to big endian and reflecting each of its bytes
+ *
+ * @param number Non reflected integer
+ *
+ * @return Reflected integer
+ */
+static uint32_t reflect_ui32 (uint32_t number)
+{
+#if 1 == CHECKSUM_HAS_RBIT
+    /* Reversing all 32 bits is the same, done with one instruction */
+    return __RBIT(number);
+#else
+    return (reflect_byte_table[number & 0xff] << 24)
+            | (reflect_byte_table[(number >> 8) & 0xff] << 16)
+            | (reflect_byte_table[(number >> 16) & 0xff] << 8)
+            | (reflect_byte_table[(number >> 24) & 0xff]);
+#endif
+}
+#endif /* 1 == CBL_CRC32_SW */
+#endif /* 1 == CBL_CKSUM_USE_CRC32 */
+
+/*** end of file ***/
@@ -0,0 +1,44 @@
+/** @file cbl_cksum_sha256.c
+ *
+ * @brief sha256 checksum provider, backend is chosen in cbl_sha256.h
+ */
+#include "etc/cbl_checksum.h"
+#if 1 == CBL_CKSUM_USE_SHA256
+#include <stdint.h>
+
+static void sha256_cksum_init (cksum_ctx_t * p_ctx);
+static cbl_err_code_t sha256_cksum_update (cksum_ctx_t * p_ctx,
+        const uint8_t * buf, uint32_t len);
+static void sha256_cksum_final (cksum_ctx_t * p_ctx, uint8_t * p_digest);
+
+const cksum_provider_t cksum_sha256 =
+{
+    .id = CKSUM_SHA256,
+    .name = TXT_CKSUM_SHA256,
+    .digest_len = SHA256_BLOCK_SIZE,
+    .len_multiple = 1u,
+    .init = sha256_cksum_init,
+    .update = sha256_cksum_update,
+    .final = sha256_cksum_final
+};
+
+static void sha256_cksum_init (cksum_ctx_t * p_ctx)
+{
+    sha_init( &p_ctx->sha256);
+}
+
+static cbl_err_code_t sha256_cksum_update (cksum_ctx_t * p_ctx,
+        const uint8_t * buf, uint32_t len)
+{
+    sha_update( &p_ctx->sha256, buf, len);
+
+    return CBL_ERR_OK;
+}
+
+static void sha256_cksum_final (cksum_ctx_t * p_ctx, uint8_t * p_digest)
+{
+    sha_final( &p_ctx->sha256, p_digest);
+}
+#endif /* 1 == CBL_CKSUM_USE_SHA256 */
+
+/*** end of file ***/
@@ -0,0 +1,42 @@
+/** @file cbl_crc32.c
+ *
+ * @brief Small CRC32 of short records, a nibble at a time
+ *
+ * @note This file is part of custom bootloader, but is also included in the
+ *       user application
+ */
+#include "etc/cbl_crc32.h"
+#include <stdint.h>
+
+/** CRC32 (reflected 0xEDB88320) of every nibble */
+static const uint32_t crc32_nibble_table[16] = { 0x00000000, 0x1DB71064,
+        0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4,
+        0xA00AE278, 0xBDBDF21C };
+
+/**
+ * @brief Calculates CRC32 of bytes, continuing from the CRC32 of bytes before
+ *
+ * @param crc[in] CRC32 of bytes before, 0 if there are none
+ * @param buf[in] Bytes
+ * @param len[in] Number of bytes
+ *
+ * @return CRC32 of bytes before and 'buf'
+ */
+uint32_t crc32_calc (uint32_t crc, const void * buf, uint32_t len)
+{
+    const uint8_t *p = (const uint8_t *)buf;
+
+    crc ^= 0xFFFFFFFF;
+
+    for (uint32_t iii = 0; iii < len; iii++)
+    {
+        crc ^= p[iii];
+        crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0F];
+        crc = (crc >> 4) ^ crc32_nibble_table[crc & 0x0F];
+    }
+
+    return crc ^ 0xFFFFFFFF;
+}
+
+/*** end of file ***/
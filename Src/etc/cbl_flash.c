@@ -0,0 +1,253 @@
+/** @file cbl_flash.c
+ *
+ * @brief Comparing flash with data before it is programmed, so bytes that
+ *        already match are neither erased nor programmed again. Geometry of
+ *        flash sectors, so only sectors a range overlaps are erased.
+ */
+#include "etc/cbl_flash.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Granules of one sector, used to fill flash_granule_sector */
+#define GRANULES_1(SECT) (SECT)
+#define GRANULES_4(SECT) (SECT), (SECT), (SECT), (SECT)
+#define GRANULES_8(SECT) GRANULES_4(SECT), GRANULES_4(SECT)
+
+/** Start and size of every sector */
+static const flash_sector_t flash_sectors[FLASH_SECTORS] = {
+        { 0x08000000UL, 16 * 1024 }, { 0x08004000UL, 16 * 1024 },
+        { 0x08008000UL, 16 * 1024 }, { 0x0800C000UL, 16 * 1024 },
+        { 0x08010000UL, 64 * 1024 }, { 0x08020000UL, 128 * 1024 },
+        { 0x08040000UL, 128 * 1024 }, { 0x08060000UL, 128 * 1024 },
+        { 0x08080000UL, 128 * 1024 }, { 0x080A0000UL, 128 * 1024 },
+        { 0x080C0000UL, 128 * 1024 }, { 0x080E0000UL, 128 * 1024 } };
+
+/** Sector of every FLASH_GRANULE_SZ of flash, address is looked up without
+ *  searching flash_sectors */
+static const uint8_t flash_granule_sector[FLASH_SZ / FLASH_GRANULE_SZ] = {
+        GRANULES_1(0), GRANULES_1(1), GRANULES_1(2), GRANULES_1(3),
+        GRANULES_4(4), GRANULES_8(5), GRANULES_8(6), GRANULES_8(7),
+        GRANULES_8(8), GRANULES_8(9), GRANULES_8(10), GRANULES_8(11) };
+
+static uint32_t flash_skip_len (uint32_t addr, const uint8_t * buf,
+        uint32_t len);
+static bool flash_word_equal (uint32_t addr, const uint8_t * buf);
+
+/**
+ * @brief Compares flash with data, word by word where flash is aligned
+ *
+ * @param addr[in] Address in flash
+ * @param buf[in]  Data to be programmed
+ * @param len[in]  Number of bytes
+ */
+flash_cmp_t flash_compare (uint32_t addr, const uint8_t * buf, uint32_t len)
+{
+    flash_cmp_t cmp = FLASH_CMP_EQUAL;
+    const volatile uint8_t *p_flash = (const volatile uint8_t *)addr;
+
+    for (uint32_t iii = 0; iii < len; iii++)
+    {
+        /* Most of flash matches or doesn't at all, words are faster */
+        if ((addr + iii) % 4 == 0 && (len - iii) >= 4
+                && flash_word_equal(addr + iii, &buf[iii]))
+        {
+            iii += 3;
+        }
+        else if (p_flash[iii] != buf[iii])
+        {
+            if (p_flash[iii] != FLASH_ERASED_BYTE)
+            {
+                return FLASH_CMP_ERASE;
+            }
+            cmp = FLASH_CMP_PROGRAM;
+        }
+    }
+
+    return cmp;
+}
+
+/**
+ * @brief Checks if flash is erased
+ *
+ * @param addr[in] Starting address
+ * @param len[in]  Number of bytes
+ */
+bool flash_is_erased (uint32_t addr, uint32_t len)
+{
+    const volatile uint8_t *p_flash = (const volatile uint8_t *)addr;
+
+    for (uint32_t iii = 0; iii < len; iii++)
+    {
+        if ((addr + iii) % 4 == 0 && (len - iii) >= 4)
+        {
+            if ( *(const volatile uint32_t *)(addr + iii) != FLASH_ERASED_WORD)
+            {
+                return false;
+            }
+            iii += 3;
+        }
+        else if (p_flash[iii] != FLASH_ERASED_BYTE)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Programs only bytes that differ from flash. Flash shall not need an
+ *        erase, see flash_compare. Matching words and programmed bytes are
+ *        skipped, matching erased bytes are programmed with their neighbours
+ *        instead of splitting the write.
+ *
+ * @param addr[in]          Address in flash
+ * @param buf[in]           Data to be programmed
+ * @param len[in]           Number of bytes
+ * @param p_skipped[in,out] Incremented by the number of bytes not programmed
+ */
+cbl_err_code_t flash_program_diff (uint32_t addr, uint8_t * buf, uint32_t len,
+        uint32_t * p_skipped)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t iii = 0;
+
+    while (iii < len)
+    {
+        uint32_t skip = flash_skip_len(addr + iii, &buf[iii], len - iii);
+        uint32_t start;
+
+        if (skip != 0)
+        {
+            iii += skip;
+            *p_skipped += skip;
+            continue;
+        }
+
+        /* Program the whole run of differing bytes at once */
+        start = iii;
+        while (iii < len && 0 == flash_skip_len(addr + iii, &buf[iii],
+                len - iii))
+        {
+            iii++;
+        }
+
+        eCode = hal_write_program_bytes(addr + start, &buf[start],
+                iii - start);
+        ERR_CHECK(eCode);
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Returns sector the address is in
+ *
+ * @param addr[in] Address in flash
+ *
+ * @return Number of the sector, FLASH_NO_SECTOR if address is not in flash
+ */
+uint32_t flash_get_sector (uint32_t addr)
+{
+    if (addr < FLASH_START || addr - FLASH_START >= FLASH_SZ)
+    {
+        return FLASH_NO_SECTOR;
+    }
+
+    return flash_granule_sector[(addr - FLASH_START) / FLASH_GRANULE_SZ];
+}
+
+/**
+ * @brief Returns start and size of the sector
+ *
+ * @param sector[in] Number of the sector, shall be less than FLASH_SECTORS
+ */
+const flash_sector_t * flash_get_sector_info (uint32_t sector)
+{
+    return &flash_sectors[sector];
+}
+
+/**
+ * @brief Returns address following the sector the address is in, e.g. where
+ *        data placed after 'addr' can start in its own sector
+ *
+ * @param addr[in] Address in flash
+ */
+uint32_t flash_get_sector_end (uint32_t addr)
+{
+    uint32_t sector = flash_get_sector(addr);
+
+    if (FLASH_NO_SECTOR == sector)
+    {
+        return addr;
+    }
+
+    return flash_sectors[sector].start + flash_sectors[sector].len;
+}
+
+/**
+ * @brief Erases every sector the range overlaps and no other. Range shall
+ *        start on a sector start to not lose the data in front of it.
+ *
+ * @param addr[in] Starting address
+ * @param len[in]  Number of bytes, nothing is erased if 0
+ */
+cbl_err_code_t flash_erase (uint32_t addr, uint32_t len)
+{
+    uint32_t first;
+    uint32_t last;
+
+    if (0 == len)
+    {
+        return CBL_ERR_OK;
+    }
+
+    first = flash_get_sector(addr);
+    last = flash_get_sector(addr + len - 1);
+
+    if (FLASH_NO_SECTOR == first || FLASH_NO_SECTOR == last
+            || len > FLASH_SZ)
+    {
+        return CBL_ERR_ERASE_RANGE;
+    }
+
+    return hal_flash_erase_sector(first, last - first + 1);
+}
+
+/**
+ * @brief Returns number of bytes at 'addr' that shall not be programmed: a
+ *        matching aligned word or a matching programmed byte, else 0
+ */
+static uint32_t flash_skip_len (uint32_t addr, const uint8_t * buf,
+        uint32_t len)
+{
+    uint8_t flash = *(const volatile uint8_t *)addr;
+
+    if (addr % 4 == 0 && len >= 4 && flash_word_equal(addr, buf))
+    {
+        return 4;
+    }
+
+    if (flash == buf[0] && flash != FLASH_ERASED_BYTE)
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Compares aligned word of flash with 4 bytes of data
+ */
+static bool flash_word_equal (uint32_t addr, const uint8_t * buf)
+{
+    uint32_t data;
+
+    /* Data may be unaligned */
+    memcpy( &data, buf, sizeof(data));
+
+    return *(const volatile uint32_t *)addr == data;
+}
+
+/*** end of file ***/
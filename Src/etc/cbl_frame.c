@@ -0,0 +1,170 @@
+/** @file cbl_frame.c
+ *
+ * @brief Frames used by the binary protocol
+ */
+#include "etc/cbl_frame.h"
+#include "etc/cbl_rx_ring.h"
+#include "etc/cbl_tx_queue.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Buffer for the received frame, body is not copied out of it */
+static uint8_t frame_rx_buf[FRAME_HDR_SZ + FRAME_MAX_BODY + FRAME_CRC_SZ];
+/** Buffer for the frame being sent, so it leaves in one transfer */
+static uint8_t frame_tx_buf[FRAME_HDR_SZ + 1u + FRAME_MAX_DATA + FRAME_CRC_SZ];
+
+/**
+ * @brief Blocks until a whole frame is received from the host. Bytes before
+ *        the sync byte are dropped.
+ *
+ * @note  Body stays valid until the next call
+ *
+ * @param p_frame[out] Received frame
+ *
+ * @return CBL_ERR_FRAME_LEN or CBL_ERR_FRAME_CRC if frame is invalid, in that
+ *         case only the opcode is filled. CBL_ERR_RX_TIMEOUT if host stopped
+ *         in the middle of the frame, opcode is 0 if it wasn't received
+ */
+cbl_err_code_t frame_recv (frame_t * p_frame)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint16_t calc_crc;
+
+    /* Not known until the header is received */
+    p_frame->opcode = 0;
+
+    /* Find the start of the frame */
+    do
+    {
+        eCode = rx_ring_recv(frame_rx_buf, 1, WAIT_FOREVER);
+        ERR_CHECK(eCode);
+    }
+    while (frame_rx_buf[0] != FRAME_SYNC);
+
+    /* Length and opcode */
+    eCode = rx_ring_recv( &frame_rx_buf[1], FRAME_HDR_SZ - 1,
+            CBL_RX_TIMEOUT_MS);
+    ERR_CHECK(eCode);
+
+    p_frame->len = frame_get_ui16( &frame_rx_buf[1]);
+    p_frame->opcode = frame_rx_buf[3];
+    p_frame->p_body = &frame_rx_buf[FRAME_HDR_SZ];
+
+    if (p_frame->len > FRAME_MAX_BODY)
+    {
+        /* Host and bootloader are out of sync, everything until the next sync
+         * byte is dropped */
+        return CBL_ERR_FRAME_LEN;
+    }
+
+    /* Body and CRC */
+    eCode = rx_ring_recv(p_frame->p_body, p_frame->len + FRAME_CRC_SZ,
+            CBL_RX_TIMEOUT_MS);
+    ERR_CHECK(eCode);
+
+    calc_crc = frame_crc16(0xFFFF, &frame_rx_buf[1],
+            FRAME_HDR_SZ - 1 + p_frame->len);
+
+    if (calc_crc != frame_get_ui16( &p_frame->p_body[p_frame->len]))
+    {
+        return CBL_ERR_FRAME_CRC;
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Sends a response frame to the host
+ *
+ * @param opcode[in] Opcode of the request
+ * @param status[in] Result of the request
+ * @param p_data[in] Data returned to the host, NULL if there is none
+ * @param len[in]    Length of 'p_data', at most FRAME_MAX_DATA
+ */
+cbl_err_code_t frame_send (uint8_t opcode, cbl_err_code_t status,
+        const uint8_t * p_data, uint32_t len)
+{
+    uint16_t body_len;
+    uint16_t crc;
+
+    if (len > FRAME_MAX_DATA)
+    {
+        return CBL_ERR_FRAME_LEN;
+    }
+
+    /* Status is the first byte of the body */
+    body_len = (uint16_t)(len + 1u);
+
+    frame_tx_buf[0] = FRAME_SYNC;
+    frame_tx_buf[1] = (uint8_t)(body_len & 0xFF);
+    frame_tx_buf[2] = (uint8_t)(body_len >> 8);
+    frame_tx_buf[3] = opcode | FRAME_RESP_FLAG;
+    frame_tx_buf[4] = (uint8_t)status;
+
+    if (p_data != NULL && len > 0)
+    {
+        memcpy( &frame_tx_buf[FRAME_HDR_SZ + 1u], p_data, len);
+    }
+
+    crc = frame_crc16(0xFFFF, &frame_tx_buf[1], FRAME_HDR_SZ - 1 + body_len);
+
+    frame_tx_buf[FRAME_HDR_SZ + body_len] = (uint8_t)(crc & 0xFF);
+    frame_tx_buf[FRAME_HDR_SZ + body_len + 1u] = (uint8_t)(crc >> 8);
+
+    return tx_queue_send((char *)frame_tx_buf,
+            FRAME_HDR_SZ + body_len + FRAME_CRC_SZ);
+}
+
+/**
+ * @brief Reads little endian uint16_t from possibly unaligned buffer
+ */
+uint16_t frame_get_ui16 (const uint8_t * buf)
+{
+    return (uint16_t)(buf[0] | (buf[1] << 8));
+}
+
+/**
+ * @brief Reads little endian uint32_t from possibly unaligned buffer
+ */
+uint32_t frame_get_ui32 (const uint8_t * buf)
+{
+    return ((uint32_t)buf[0]) | ((uint32_t)buf[1] << 8)
+            | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+/**
+ * @brief Writes uint32_t as little endian to possibly unaligned buffer
+ */
+void frame_put_ui32 (uint8_t * buf, uint32_t num)
+{
+    buf[0] = (uint8_t)(num & 0xFF);
+    buf[1] = (uint8_t)((num >> 8) & 0xFF);
+    buf[2] = (uint8_t)((num >> 16) & 0xFF);
+    buf[3] = (uint8_t)((num >> 24) & 0xFF);
+}
+
+/**
+ * @brief Accumulates CRC-16/CCITT-FALSE (polynomial 0x1021, no reflection).
+ *        Start with 0xFFFF.
+ *
+ * @param crc[in] Previous CRC value
+ * @param buf[in] Bytes to accumulate
+ * @param len[in] Length of 'buf'
+ */
+uint16_t frame_crc16 (uint16_t crc, const uint8_t * buf, uint32_t len)
+{
+    for (uint32_t iii = 0; iii < len; iii++)
+    {
+        crc = (uint16_t)((crc >> 8) | (crc << 8));
+        crc ^= buf[iii];
+        crc ^= (crc & 0xFF) >> 4;
+        crc ^= (uint16_t)(crc << 12);
+        crc ^= (uint16_t)((crc & 0xFF) << 5);
+    }
+
+    return crc;
+}
+
+/*** end of file ***/
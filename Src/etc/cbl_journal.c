@@ -0,0 +1,220 @@
+/** @file cbl_journal.c
+ *
+ * @brief Journal of new application transfer progress, so an interrupted
+ *        update-new can be resumed
+ */
+#include "etc/cbl_journal.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define JOURNAL_ERASED 0xFFFFFFFFUL
+#define JOURNAL_HDR_SZ (8u + sizeof(journal_xfer_t))
+
+/** Address of the next free progress entry, 0 if there is no journal */
+static uint32_t journal_pos = 0;
+
+static uint32_t journal_find (uint32_t * p_hdr);
+static bool journal_is_erased (uint32_t addr);
+
+/**
+ * @brief Starts a journal of a new transfer after the journals before, only
+ *        the last one is valid
+ *
+ * @param p_xfer[in] Parameters of the transfer, needed to resume it
+ */
+cbl_err_code_t journal_start (const journal_xfer_t * p_xfer)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t magic = JOURNAL_MAGIC;
+    uint32_t seq;
+    uint32_t hdr;
+    uint32_t addr;
+
+    /* Journal belongs to a boot record, it is written if there is none */
+    boot_record_get();
+    seq = boot_record_get_seq();
+    if (BOOT_RECORD_NO_SEQ == seq)
+    {
+        return CBL_ERR_STATE;
+    }
+
+    addr = journal_find( &hdr);
+
+    if (JOURNAL_END - addr < JOURNAL_MIN_FREE)
+    {
+        eCode = boot_record_compact();
+        ERR_CHECK(eCode);
+
+        addr = JOURNAL_START;
+    }
+
+    /* Magic goes last, so interrupted start leaves no journal */
+    eCode = hal_write_program_bytes(addr + 4, (uint8_t *) &seq, sizeof(seq));
+    ERR_CHECK(eCode);
+
+    eCode = hal_write_program_bytes(addr + 8, (uint8_t *)p_xfer,
+            sizeof( *p_xfer));
+    ERR_CHECK(eCode);
+
+    eCode = hal_write_program_bytes(addr, (uint8_t *) &magic, sizeof(magic));
+    ERR_CHECK(eCode);
+
+    journal_pos = addr + JOURNAL_HDR_SZ;
+
+    return eCode;
+}
+
+/**
+ * @brief Gets the transfer from the journal and its progress
+ *
+ * @param p_xfer[out] Parameters of the transfer
+ * @param p_done[out] Number of bytes written before it was interrupted
+ */
+cbl_err_code_t journal_get (journal_xfer_t * p_xfer, uint32_t * p_done)
+{
+    uint32_t hdr;
+    uint32_t end = journal_find( &hdr);
+
+    if (0 == hdr
+            || *(volatile uint32_t *)(hdr + 4) != boot_record_get_seq())
+    {
+        return CBL_ERR_NO_JOURNAL;
+    }
+
+    memcpy(p_xfer, (void *)(hdr + 8), sizeof( *p_xfer));
+    *p_done = 0;
+
+    for (uint32_t addr = hdr + JOURNAL_HDR_SZ; addr < end; addr += 4)
+    {
+        /* Entry torn by power loss is skipped */
+        if ( *(volatile uint32_t *)addr <= p_xfer->len)
+        {
+            *p_done = *(volatile uint32_t *)addr;
+        }
+    }
+
+    journal_pos = end;
+
+    return CBL_ERR_OK;
+}
+
+/**
+ * @brief Records that the transfer wrote 'done' bytes. When journal is full
+ *        progress is not recorded any more, resume then starts earlier.
+ *
+ * @param done[in] Number of bytes written from the start of the transfer
+ */
+cbl_err_code_t journal_commit (uint32_t done)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    if (0 == journal_pos || journal_pos >= JOURNAL_END)
+    {
+        return eCode;
+    }
+
+    eCode = hal_write_program_bytes(journal_pos, (uint8_t *) &done,
+            sizeof(done));
+    ERR_CHECK(eCode);
+
+    journal_pos += 4;
+
+    return eCode;
+}
+
+/**
+ * @brief Clears the journal, so the transfer it belongs to can't be resumed
+ */
+cbl_err_code_t journal_clear (void)
+{
+    uint32_t clear = JOURNAL_CLEAR;
+    uint32_t hdr;
+    uint32_t addr = journal_find( &hdr);
+
+    journal_pos = 0;
+
+    if (0 == hdr)
+    {
+        return CBL_ERR_OK;
+    }
+
+    /* No room for the mark, compacting erases all journals */
+    if (addr >= JOURNAL_END)
+    {
+        return boot_record_compact();
+    }
+
+    return hal_write_program_bytes(addr, (uint8_t *) &clear, sizeof(clear));
+}
+
+/**
+ * @brief Finds the last journal and the end of journals
+ *
+ * @param p_hdr[out] Address of the last journal, 0 if there is none or it
+ *                   was cleared
+ *
+ * @return Address of the first erased word not followed by a header
+ *         interrupted before its magic, JOURNAL_END if there is none
+ */
+static uint32_t journal_find (uint32_t * p_hdr)
+{
+    uint32_t addr = JOURNAL_START;
+
+    *p_hdr = 0;
+
+    /* Progress never reaches the marks, it is not mistaken for one */
+    while (addr < JOURNAL_END)
+    {
+        if ( *(volatile uint32_t *)addr == JOURNAL_ERASED)
+        {
+            /* Start interrupted before the magic, its words are not free */
+            if (journal_is_erased(addr))
+            {
+                break;
+            }
+
+            *p_hdr = 0;
+            addr += JOURNAL_HDR_SZ;
+        }
+        else if ( *(volatile uint32_t *)addr == JOURNAL_MAGIC
+                && JOURNAL_END - addr >= JOURNAL_HDR_SZ)
+        {
+            *p_hdr = addr;
+            addr += JOURNAL_HDR_SZ;
+        }
+        else if ( *(volatile uint32_t *)addr == JOURNAL_CLEAR)
+        {
+            *p_hdr = 0;
+            addr += 4;
+        }
+        else
+        {
+            addr += 4;
+        }
+    }
+
+    return ui32_min(addr, JOURNAL_END);
+}
+
+/**
+ * @brief Checks whether a header slot is erased, up to the end of journals
+ *
+ * @param addr[in] Address of the slot
+ */
+static bool journal_is_erased (uint32_t addr)
+{
+    uint32_t end = ui32_min(addr + JOURNAL_HDR_SZ, JOURNAL_END);
+
+    for (; addr < end; addr += 4)
+    {
+        if ( *(volatile uint32_t *)addr != JOURNAL_ERASED)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*** end of file ***/
@@ -0,0 +1,479 @@
+/** @file cbl_lz4.c
+ *
+ * @brief Streaming decoder of LZ4 frames. Format is described in
+ *        lz4_Frame_format.md and lz4_Block_format.md of the LZ4 project.
+ */
+#include "etc/cbl_lz4.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define LZ4_MAGIC 0x184D2204UL
+#define LZ4_FLG_VERSION_MASK 0xC0u
+#define LZ4_FLG_VERSION 0x40u
+#define LZ4_FLG_BLK_CKSUM 0x10u
+#define LZ4_FLG_CONTENT_SZ 0x08u
+#define LZ4_FLG_CONTENT_CKSUM 0x04u
+#define LZ4_FLG_DICT_ID 0x01u
+#define LZ4_BLK_RAW 0x80000000UL /*!< Block size flag of uncompressed block */
+#define LZ4_CKSUM_SZ 4u
+#define LZ4_CONTENT_SZ_SZ 8u
+#define LZ4_HC_SZ 1u /*!< Header checksum */
+#define LZ4_LEN_MORE 15u /*!< Length continues in the following bytes */
+#define LZ4_MIN_MATCH 4u
+
+static bool lz4_field (lz4_dec_t * p_dec, uint8_t byte, uint32_t len);
+static void lz4_skip (lz4_dec_t * p_dec, uint32_t len, lz4_state_t next);
+static void lz4_blk_end (lz4_dec_t * p_dec);
+static void lz4_lit_end (lz4_dec_t * p_dec);
+static cbl_err_code_t lz4_put (lz4_dec_t * p_dec, const uint8_t * p_in,
+        uint32_t len);
+static cbl_err_code_t lz4_match (lz4_dec_t * p_dec);
+static cbl_err_code_t lz4_flush (lz4_dec_t * p_dec);
+
+/**
+ * @brief Prepares decoder for a new frame
+ *
+ * @param p_dec[out]  Decoder
+ * @param start[in]   Address of the first decompressed byte, already written
+ *                    bytes are read back from there
+ * @param max_len[in] Maximum number of decompressed bytes
+ * @param out[in]     Output function for decompressed bytes
+ * @param p_ctx[in]   Passed to 'out'
+ */
+void lz4_init (lz4_dec_t * p_dec, uint32_t start, uint32_t max_len,
+        lz4_out_t out, void * p_ctx)
+{
+    /* Output buffer is the last member, it doesn't need clearing */
+    memset(p_dec, 0, sizeof( *p_dec) - sizeof(p_dec->out_buf));
+
+    p_dec->state = LZ4_ST_MAGIC;
+    p_dec->start = start;
+    p_dec->max_len = max_len;
+    p_dec->out = out;
+    p_dec->p_ctx = p_ctx;
+}
+
+/**
+ * @brief Decodes next part of the frame
+ *
+ * @param p_dec[in] Decoder
+ * @param p_in[in]  Compressed bytes
+ * @param len[in]   Number of compressed bytes
+ */
+cbl_err_code_t lz4_feed (lz4_dec_t * p_dec, const uint8_t * p_in,
+        uint32_t len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    while (len > 0)
+    {
+        uint32_t used = 1; /* Most states consume one byte */
+        uint8_t byte = *p_in;
+
+        switch (p_dec->state)
+        {
+            case LZ4_ST_MAGIC:
+            {
+                if (true == lz4_field(p_dec, byte, 4))
+                {
+                    if (p_dec->field != LZ4_MAGIC)
+                    {
+                        return CBL_ERR_DECOMP;
+                    }
+                    p_dec->state = LZ4_ST_FLG;
+                }
+            }
+            break;
+
+            case LZ4_ST_FLG:
+            {
+                if ((byte & LZ4_FLG_VERSION_MASK) != LZ4_FLG_VERSION
+                        || (byte & LZ4_FLG_DICT_ID) != 0)
+                {
+                    return CBL_ERR_DECOMP;
+                }
+                p_dec->flg = byte;
+                p_dec->state = LZ4_ST_BD;
+            }
+            break;
+
+            case LZ4_ST_BD:
+            {
+                /* Block maximum size doesn't matter, blocks are streamed */
+                lz4_skip(p_dec,
+                        ((p_dec->flg & LZ4_FLG_CONTENT_SZ) ?
+                                LZ4_CONTENT_SZ_SZ : 0) + LZ4_HC_SZ,
+                        LZ4_ST_BLK_SIZE);
+            }
+            break;
+
+            case LZ4_ST_SKIP:
+            {
+                used = ui32_min(len, p_dec->skip);
+                p_dec->skip -= used;
+                if (0 == p_dec->skip)
+                {
+                    p_dec->state = p_dec->next;
+                }
+            }
+            break;
+
+            case LZ4_ST_BLK_SIZE:
+            {
+                if (false == lz4_field(p_dec, byte, 4))
+                {
+                    break;
+                }
+
+                if (0 == p_dec->field)
+                {
+                    /* End mark */
+                    if (p_dec->flg & LZ4_FLG_CONTENT_CKSUM)
+                    {
+                        lz4_skip(p_dec, LZ4_CKSUM_SZ, LZ4_ST_DONE);
+                    }
+                    else
+                    {
+                        p_dec->state = LZ4_ST_DONE;
+                    }
+                }
+                else
+                {
+                    p_dec->blk_left = p_dec->field & ~LZ4_BLK_RAW;
+                    p_dec->state = (p_dec->field & LZ4_BLK_RAW) ?
+                            LZ4_ST_BLK_RAW : LZ4_ST_TOKEN;
+
+                    if (0 == p_dec->blk_left)
+                    {
+                        /* Empty uncompressed block */
+                        lz4_blk_end(p_dec);
+                    }
+                }
+            }
+            break;
+
+            case LZ4_ST_BLK_RAW:
+            {
+                used = ui32_min(len, p_dec->blk_left);
+
+                eCode = lz4_put(p_dec, p_in, used);
+                ERR_CHECK(eCode);
+
+                p_dec->blk_left -= used;
+                if (0 == p_dec->blk_left)
+                {
+                    lz4_blk_end(p_dec);
+                }
+            }
+            break;
+
+            case LZ4_ST_TOKEN:
+            {
+                if (0 == p_dec->blk_left)
+                {
+                    /* Last sequence of the block shall have no match */
+                    return CBL_ERR_DECOMP;
+                }
+                p_dec->blk_left--;
+
+                p_dec->lit_len = byte >> 4;
+                p_dec->match_len = byte & 0x0Fu;
+
+                if (LZ4_LEN_MORE == p_dec->lit_len)
+                {
+                    p_dec->state = LZ4_ST_LIT_LEN;
+                }
+                else if (0 == p_dec->lit_len)
+                {
+                    lz4_lit_end(p_dec);
+                }
+                else
+                {
+                    p_dec->state = LZ4_ST_LIT;
+                }
+            }
+            break;
+
+            case LZ4_ST_LIT_LEN:
+            {
+                if (0 == p_dec->blk_left)
+                {
+                    return CBL_ERR_DECOMP;
+                }
+                p_dec->blk_left--;
+
+                p_dec->lit_len += byte;
+                if (byte != 0xFFu)
+                {
+                    p_dec->state = LZ4_ST_LIT;
+                }
+            }
+            break;
+
+            case LZ4_ST_LIT:
+            {
+                used = ui32_min(ui32_min(len, p_dec->lit_len),
+                        p_dec->blk_left);
+                if (0 == used)
+                {
+                    /* Literals go past the end of the block */
+                    return CBL_ERR_DECOMP;
+                }
+
+                eCode = lz4_put(p_dec, p_in, used);
+                ERR_CHECK(eCode);
+
+                p_dec->lit_len -= used;
+                p_dec->blk_left -= used;
+                if (0 == p_dec->lit_len)
+                {
+                    lz4_lit_end(p_dec);
+                }
+            }
+            break;
+
+            case LZ4_ST_OFFSET:
+            {
+                if (0 == p_dec->blk_left)
+                {
+                    return CBL_ERR_DECOMP;
+                }
+                p_dec->blk_left--;
+
+                if (false == lz4_field(p_dec, byte, 2))
+                {
+                    break;
+                }
+
+                if (LZ4_LEN_MORE == p_dec->match_len)
+                {
+                    p_dec->state = LZ4_ST_MATCH_LEN;
+                }
+                else
+                {
+                    eCode = lz4_match(p_dec);
+                    ERR_CHECK(eCode);
+                }
+            }
+            break;
+
+            case LZ4_ST_MATCH_LEN:
+            {
+                if (0 == p_dec->blk_left)
+                {
+                    return CBL_ERR_DECOMP;
+                }
+                p_dec->blk_left--;
+
+                p_dec->match_len += byte;
+                if (byte != 0xFFu)
+                {
+                    eCode = lz4_match(p_dec);
+                    ERR_CHECK(eCode);
+                }
+            }
+            break;
+
+            case LZ4_ST_DONE:
+                /* No break */
+            default:
+            {
+                /* Bytes after the end of the frame */
+                return CBL_ERR_DECOMP;
+            }
+            break;
+        }
+
+        p_in += used;
+        len -= used;
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Checks that the whole frame was decoded and outputs the remaining
+ *        decompressed bytes
+ *
+ * @param p_dec[in]  Decoder
+ * @param p_len[out] Number of decompressed bytes
+ */
+cbl_err_code_t lz4_finish (lz4_dec_t * p_dec, uint32_t * p_len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    if (p_dec->state != LZ4_ST_DONE)
+    {
+        return CBL_ERR_DECOMP;
+    }
+
+    eCode = lz4_flush(p_dec);
+    ERR_CHECK(eCode);
+
+    *p_len = p_dec->out_done;
+
+    return eCode;
+}
+
+/**
+ * @brief Receives multi-byte little endian field into p_dec->field
+ *
+ * @return true when all 'len' bytes are received, field_len is then reset
+ */
+static bool lz4_field (lz4_dec_t * p_dec, uint8_t byte, uint32_t len)
+{
+    if (0 == p_dec->field_len)
+    {
+        p_dec->field = 0;
+    }
+
+    p_dec->field |= (uint32_t)byte << (8 * p_dec->field_len);
+    p_dec->field_len++;
+
+    if (p_dec->field_len == len)
+    {
+        p_dec->field_len = 0;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Ignores next 'len' bytes, then continues with state 'next'
+ */
+static void lz4_skip (lz4_dec_t * p_dec, uint32_t len, lz4_state_t next)
+{
+    p_dec->skip = len;
+    p_dec->next = next;
+    p_dec->state = LZ4_ST_SKIP;
+}
+
+/**
+ * @brief Continues after the last byte of a block
+ */
+static void lz4_blk_end (lz4_dec_t * p_dec)
+{
+    if (p_dec->flg & LZ4_FLG_BLK_CKSUM)
+    {
+        lz4_skip(p_dec, LZ4_CKSUM_SZ, LZ4_ST_BLK_SIZE);
+    }
+    else
+    {
+        p_dec->state = LZ4_ST_BLK_SIZE;
+    }
+}
+
+/**
+ * @brief Continues after literals of a sequence, last sequence of the block
+ *        has no match
+ */
+static void lz4_lit_end (lz4_dec_t * p_dec)
+{
+    if (0 == p_dec->blk_left)
+    {
+        lz4_blk_end(p_dec);
+    }
+    else
+    {
+        p_dec->state = LZ4_ST_OFFSET;
+    }
+}
+
+/**
+ * @brief Appends decompressed bytes to the output buffer, full buffer is
+ *        passed to the output function
+ */
+static cbl_err_code_t lz4_put (lz4_dec_t * p_dec, const uint8_t * p_in,
+        uint32_t len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    if (len > p_dec->max_len - p_dec->out_done - p_dec->out_len)
+    {
+        return CBL_ERR_DECOMP;
+    }
+
+    while (len > 0)
+    {
+        uint32_t n = ui32_min(len, LZ4_OUT_SZ - p_dec->out_len);
+
+        memcpy( &p_dec->out_buf[p_dec->out_len], p_in, n);
+        p_dec->out_len += n;
+        p_in += n;
+        len -= n;
+
+        if (LZ4_OUT_SZ == p_dec->out_len)
+        {
+            eCode = lz4_flush(p_dec);
+            ERR_CHECK(eCode);
+        }
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Copies the match of the sequence. Bytes still in the output buffer
+ *        are copied from it, older ones are read back from the output memory.
+ *        Match can overlap itself, so it is copied byte by byte.
+ */
+static cbl_err_code_t lz4_match (lz4_dec_t * p_dec)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    uint32_t offset = p_dec->field;
+    uint32_t len = p_dec->match_len + LZ4_MIN_MATCH;
+    uint32_t pos = p_dec->out_done + p_dec->out_len;
+
+    if (0 == offset || offset > pos)
+    {
+        return CBL_ERR_DECOMP;
+    }
+
+    for (uint32_t iii = 0; iii < len; iii++, pos++)
+    {
+        uint32_t src = pos - offset;
+        uint8_t byte;
+
+        if (src >= p_dec->out_done)
+        {
+            byte = p_dec->out_buf[src - p_dec->out_done];
+        }
+        else
+        {
+            byte = *(const uint8_t *)(p_dec->start + src);
+        }
+
+        eCode = lz4_put(p_dec, &byte, 1);
+        ERR_CHECK(eCode);
+    }
+
+    p_dec->state = LZ4_ST_TOKEN;
+
+    return eCode;
+}
+
+/**
+ * @brief Passes buffered decompressed bytes to the output function
+ */
+static cbl_err_code_t lz4_flush (lz4_dec_t * p_dec)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    if (0 == p_dec->out_len)
+    {
+        return eCode;
+    }
+
+    eCode = p_dec->out(p_dec->start + p_dec->out_done, p_dec->out_buf,
+            p_dec->out_len, p_dec->p_ctx);
+    ERR_CHECK(eCode);
+
+    p_dec->out_done += p_dec->out_len;
+    p_dec->out_len = 0;
+
+    return eCode;
+}
+
+/*** end of file ***/
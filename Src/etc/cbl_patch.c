@@ -0,0 +1,203 @@
+/** @file cbl_patch.c
+ *
+ * @brief Binary patches (bsdiff style) that rebuild a new application from the
+ *        active one
+ */
+#include "etc/cbl_patch.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define PATCH_OUT_SZ 1024u /*!< Rebuilt bytes are written in pieces of it */
+
+/** Rebuilt bytes waiting to be written to flash */
+static uint8_t patch_out_buf[PATCH_OUT_SZ];
+
+static uint32_t patch_get_ui32 (uint32_t addr);
+static void patch_digest (uint32_t addr, uint32_t len, uint8_t * p_digest);
+static cbl_err_code_t patch_out (uint32_t * p_addr, uint32_t * p_out_len,
+        sha_ctx_t * ph_sha256);
+
+/**
+ * @brief Reads and checks the header of the patch
+ *
+ * @param patch_addr[in] Address of the patch
+ * @param patch_len[in]  Length of the patch
+ * @param p_hdr[out]     Header of the patch
+ */
+cbl_err_code_t patch_get_header (uint32_t patch_addr, uint32_t patch_len,
+        patch_hdr_t * p_hdr)
+{
+    if (patch_len < PATCH_HDR_SZ || patch_get_ui32(patch_addr) != PATCH_MAGIC)
+    {
+        return CBL_ERR_INV_PATCH;
+    }
+
+    p_hdr->old_len = patch_get_ui32(patch_addr + 4);
+    p_hdr->new_len = patch_get_ui32(patch_addr + 8);
+    memcpy(p_hdr->old_digest, (uint8_t *)(patch_addr + 12), SHA256_BLOCK_SIZE);
+    memcpy(p_hdr->new_digest,
+            (uint8_t *)(patch_addr + 12 + SHA256_BLOCK_SIZE),
+            SHA256_BLOCK_SIZE);
+
+    return CBL_ERR_OK;
+}
+
+/**
+ * @brief Rebuilds the new application from the old one and the patch.
+ *        Old application is checked against the digest in the patch first.
+ *
+ * @param patch_addr[in] Address of the patch
+ * @param patch_len[in]  Length of the patch
+ * @param old_addr[in]   Address of the application patch applies to
+ * @param new_addr[in]   Address to rebuild to, shall be erased
+ * @param p_digest[in]   Expected sha256 of rebuilt application
+ */
+cbl_err_code_t patch_apply (uint32_t patch_addr, uint32_t patch_len,
+        uint32_t old_addr, uint32_t new_addr, const uint8_t * p_digest)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+    patch_hdr_t hdr;
+    sha_ctx_t h_sha256;
+    uint8_t digest[SHA256_BLOCK_SIZE];
+    uint32_t patch_pos = PATCH_HDR_SZ;
+    uint32_t old_pos = 0;
+    uint32_t new_pos = 0;
+    uint32_t out_len = 0;
+    const uint8_t *p_old = (const uint8_t *)old_addr;
+
+    eCode = patch_get_header(patch_addr, patch_len, &hdr);
+    ERR_CHECK(eCode);
+
+    /* Patch of some other application would rebuild garbage */
+    patch_digest(old_addr, hdr.old_len, digest);
+    if (memcmp(digest, hdr.old_digest, SHA256_BLOCK_SIZE) != 0)
+    {
+        return CBL_ERR_PATCH_BASE;
+    }
+
+    sha_init( &h_sha256);
+
+    while (new_pos < hdr.new_len)
+    {
+        uint32_t diff_len;
+        uint32_t extra_len;
+        int32_t adjust;
+        const uint8_t *p_patch;
+
+        if (patch_len - patch_pos < PATCH_REC_HDR_SZ)
+        {
+            return CBL_ERR_INV_PATCH;
+        }
+
+        diff_len = patch_get_ui32(patch_addr + patch_pos);
+        extra_len = patch_get_ui32(patch_addr + patch_pos + 4);
+        adjust = (int32_t)patch_get_ui32(patch_addr + patch_pos + 8);
+        patch_pos += PATCH_REC_HDR_SZ;
+        p_patch = (const uint8_t *)(patch_addr + patch_pos);
+
+        if (diff_len > patch_len - patch_pos
+                || extra_len > patch_len - patch_pos - diff_len
+                || diff_len > hdr.old_len - old_pos
+                || diff_len + extra_len > hdr.new_len - new_pos)
+        {
+            return CBL_ERR_INV_PATCH;
+        }
+
+        /* Diff bytes are added to old ones, extra bytes are new */
+        for (uint32_t iii = 0; iii < diff_len + extra_len; iii++)
+        {
+            if (iii < diff_len)
+            {
+                patch_out_buf[out_len] = p_old[old_pos + iii] + p_patch[iii];
+            }
+            else
+            {
+                patch_out_buf[out_len] = p_patch[iii];
+            }
+            out_len++;
+
+            if (PATCH_OUT_SZ == out_len)
+            {
+                eCode = patch_out( &new_addr, &out_len, &h_sha256);
+                ERR_CHECK(eCode);
+            }
+        }
+
+        patch_pos += diff_len + extra_len;
+        new_pos += diff_len + extra_len;
+        old_pos += diff_len + adjust;
+
+        if (old_pos > hdr.old_len)
+        {
+            return CBL_ERR_INV_PATCH;
+        }
+    }
+
+    eCode = patch_out( &new_addr, &out_len, &h_sha256);
+    ERR_CHECK(eCode);
+
+    sha_final( &h_sha256, digest);
+    if (patch_pos != patch_len
+            || memcmp(digest, p_digest, SHA256_BLOCK_SIZE) != 0)
+    {
+        return CBL_ERR_PATCH_DIGEST;
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Reads little endian word from possibly unaligned address
+ */
+static uint32_t patch_get_ui32 (uint32_t addr)
+{
+    const uint8_t *p = (const uint8_t *)addr;
+
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16)
+            | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * @brief Calculates sha256 of memory
+ */
+static void patch_digest (uint32_t addr, uint32_t len, uint8_t * p_digest)
+{
+    sha_ctx_t h_sha256;
+
+    sha_init( &h_sha256);
+    sha_update( &h_sha256, (const uint8_t *)addr, len);
+    sha_final( &h_sha256, p_digest);
+}
+
+/**
+ * @brief Writes rebuilt bytes to flash and accumulates them into the digest
+ *
+ * @param p_addr[in,out]    Address to write to, moved past written bytes
+ * @param p_out_len[in,out] Number of bytes in patch_out_buf, set to 0
+ * @param ph_sha256[in]     Digest of rebuilt bytes
+ */
+static cbl_err_code_t patch_out (uint32_t * p_addr, uint32_t * p_out_len,
+        sha_ctx_t * ph_sha256)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    if (0 == *p_out_len)
+    {
+        return eCode;
+    }
+
+    hal_led_on(LED_MEMORY);
+    eCode = hal_write_program_bytes( *p_addr, patch_out_buf, *p_out_len);
+    hal_led_off(LED_MEMORY);
+    ERR_CHECK(eCode);
+
+    sha_update(ph_sha256, patch_out_buf, *p_out_len);
+
+    *p_addr += *p_out_len;
+    *p_out_len = 0;
+
+    return eCode;
+}
+
+/*** end of file ***/
@@ -0,0 +1,91 @@
+/** @file cbl_retained.c
+ *
+ * @brief State that changes on every update or start, kept in memory that
+ *        survives reset instead of flash
+ */
+#include "etc/cbl_retained.h"
+#include "etc/cbl_crc32.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define RETAINED_CRC_LEN (sizeof(retained_t) - 4u)
+
+static uint32_t retained_crc (const retained_t * p_ret);
+
+/**
+ * @brief Reads retained state
+ *
+ * @param p_ret[out] Retained state, cleared if retained memory was lost
+ */
+void retained_get (retained_t * p_ret)
+{
+    if (hal_retained_read((uint8_t *)p_ret, sizeof( *p_ret)) != CBL_ERR_OK
+            || p_ret->magic != RETAINED_MAGIC
+            || p_ret->crc != retained_crc(p_ret))
+    {
+        memset(p_ret, 0, sizeof( *p_ret));
+        p_ret->magic = RETAINED_MAGIC;
+    }
+}
+
+/**
+ * @brief Writes retained state
+ *
+ * @param p_ret[in] Retained state, its CRC32 is set
+ */
+cbl_err_code_t retained_set (retained_t * p_ret)
+{
+    p_ret->magic = RETAINED_MAGIC;
+    p_ret->crc = retained_crc(p_ret);
+
+    return hal_retained_write((const uint8_t *)p_ret, sizeof( *p_ret));
+}
+
+/**
+ * @brief Returns if 'flag' is set
+ *
+ * @param flag[in] One of RETAINED_* flags
+ */
+bool retained_flag_get (uint32_t flag)
+{
+    retained_t ret;
+
+    retained_get( &ret);
+
+    return (ret.flags & flag) != 0;
+}
+
+/**
+ * @brief Sets or clears 'flag'
+ *
+ * @param flag[in]   One of RETAINED_* flags
+ * @param is_set[in] true to set, false to clear
+ */
+cbl_err_code_t retained_flag_set (uint32_t flag, bool is_set)
+{
+    retained_t ret;
+
+    retained_get( &ret);
+
+    if (is_set)
+    {
+        ret.flags |= flag;
+    }
+    else
+    {
+        ret.flags &= ~flag;
+    }
+
+    return retained_set( &ret);
+}
+
+/**
+ * @brief Calculates CRC32 of the fields before 'crc'
+ */
+static uint32_t retained_crc (const retained_t * p_ret)
+{
+    return crc32_calc(0, p_ret, RETAINED_CRC_LEN);
+}
+
+/*** end of file ***/
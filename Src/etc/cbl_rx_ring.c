@@ -0,0 +1,164 @@
+/** @file cbl_rx_ring.c
+ *
+ * @brief Ring buffer for bytes received from the host. HAL receives bytes
+ *        continuously (circular DMA or RXNE interrupt) and feeds them from
+ *        the interrupt, bootloader consumes them from the main loop.
+ */
+#include "etc/cbl_rx_ring.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RX_RING_MASK (RX_RING_SZ - 1u)
+
+#if (RX_RING_SZ & RX_RING_MASK) != 0
+#error "RX_RING_SZ shall be power of 2"
+#endif
+
+/** Bytes received from the host, written by DMA or interrupt */
+static uint8_t rx_ring_buf[RX_RING_SZ];
+/** Number of bytes ever received, written only by the interrupt */
+static volatile uint32_t rx_ring_head = 0;
+/** Number of bytes ever consumed, written only by the main loop */
+static volatile uint32_t rx_ring_tail = 0;
+/** Last position reported by circular DMA */
+static volatile uint32_t rx_ring_dma_pos = 0;
+static bool rx_ring_is_started = false;
+
+static bool rx_ring_has (uint32_t len);
+
+/**
+ * @brief Starts continuous reception from the host, if not already started
+ */
+cbl_err_code_t rx_ring_start (void)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    if (true == rx_ring_is_started)
+    {
+        return eCode;
+    }
+
+    rx_ring_head = 0;
+    rx_ring_tail = 0;
+    rx_ring_dma_pos = 0;
+
+    eCode = hal_recv_from_host_circular_start(rx_ring_buf, RX_RING_SZ);
+    ERR_CHECK(eCode);
+
+    rx_ring_is_started = true;
+
+    return eCode;
+}
+
+/**
+ * @brief Returns number of received bytes that were not consumed yet
+ */
+uint32_t rx_ring_count (void)
+{
+    return rx_ring_head - rx_ring_tail;
+}
+
+/**
+ * @brief Consumes up to 'len' received bytes, doesn't block
+ *
+ * @param buf[out] Buffer for bytes
+ * @param len[in]  Maximum number of bytes to consume
+ *
+ * @return Number of consumed bytes
+ */
+uint32_t rx_ring_read (uint8_t * buf, uint32_t len)
+{
+    uint32_t tail = rx_ring_tail;
+    uint32_t idx = tail & RX_RING_MASK;
+    uint32_t first_len;
+
+    len = ui32_min(len, rx_ring_count());
+
+    /* Bytes can wrap around the end of the ring */
+    first_len = ui32_min(len, RX_RING_SZ - idx);
+
+    memcpy(buf, &rx_ring_buf[idx], first_len);
+    memcpy( &buf[first_len], rx_ring_buf, len - first_len);
+
+    /* Release the space only after the bytes are copied out */
+    rx_ring_tail = tail + len;
+
+    return len;
+}
+
+/**
+ * @brief Sleeps until 'len' bytes are received from the host
+ *
+ * @param buf[out]       Buffer for bytes
+ * @param len[in]        Number of bytes to receive, at most RX_RING_SZ
+ * @param timeout_ms[in] Milliseconds to wait for all bytes, or WAIT_FOREVER
+ */
+cbl_err_code_t rx_ring_recv (uint8_t * buf, uint32_t len,
+        uint32_t timeout_ms)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    eCode = rx_ring_start();
+    ERR_CHECK(eCode);
+
+    eCode = wait_until(rx_ring_has, len, timeout_ms);
+    ERR_CHECK(eCode);
+
+    if (rx_ring_count() > RX_RING_SZ)
+    {
+        /* Host sent more than the ring can hold, unread bytes are lost */
+        rx_ring_flush();
+        return CBL_ERR_RX_OVERRUN;
+    }
+
+    rx_ring_read(buf, len);
+
+    return eCode;
+}
+
+/**
+ * @brief Drops all received bytes that were not consumed yet
+ */
+void rx_ring_flush (void)
+{
+    rx_ring_tail = rx_ring_head;
+}
+
+/**
+ * @brief Called by HAL from DMA half transfer, DMA full transfer and UART idle
+ *        line interrupts
+ *
+ * @param pos[in] Index in the ring DMA will write the next byte to
+ *                (ring size - DMA counter)
+ */
+void rx_ring_isr_update (uint32_t pos)
+{
+    /* DMA position wraps, head counts all bytes ever received */
+    rx_ring_head += (pos - rx_ring_dma_pos) & RX_RING_MASK;
+    rx_ring_dma_pos = pos & RX_RING_MASK;
+}
+
+/**
+ * @brief Called by HAL from RXNE interrupt for every received byte
+ *
+ * @param byte[in] Received byte
+ */
+void rx_ring_isr_put (uint8_t byte)
+{
+    uint32_t head = rx_ring_head;
+
+    rx_ring_buf[head & RX_RING_MASK] = byte;
+    rx_ring_head = head + 1u;
+}
+
+/**
+ * @brief Checks if at least 'len' bytes wait in the ring
+ */
+static bool rx_ring_has (uint32_t len)
+{
+    return rx_ring_count() >= len;
+}
+
+/*** end of file ***/
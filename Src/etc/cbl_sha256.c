@@ -0,0 +1,281 @@
+/** @file cbl_sha256.c
+ *
+ * @brief SHA-256 used by checksums and patches
+ */
+#include "etc/cbl_sha256.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if CBL_SHA256_SW == CBL_SHA256_BACKEND
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define CH(x, y, z) (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define EP0(x) (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define EP1(x) (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define SIG0(x) (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define SIG1(x) (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+
+/* Message schedule is kept in 16 words, word 'i' replaces word 'i - 16' */
+#define W(i) (w[(i) & 15] += SIG1(w[((i) - 2) & 15]) + w[((i) - 7) & 15] \
+        + SIG0(w[((i) - 15) & 15]))
+
+/* Round 'i', instead of moving the working variables their names rotate */
+#define RND(a, b, c, d, e, f, g, h, i, wi) \
+    do \
+    { \
+        uint32_t t1 = (h) + EP1(e) + CH(e, f, g) + sha_k[i] + (wi); \
+        (d) += t1; \
+        (h) = t1 + EP0(a) + MAJ(a, b, c); \
+    } \
+    while (0)
+
+/* Eight rounds bring names back to their places */
+#define RND8_FIRST(i) \
+    RND(a, b, c, d, e, f, g, h, (i) + 0, w[(i) + 0]); \
+    RND(h, a, b, c, d, e, f, g, (i) + 1, w[(i) + 1]); \
+    RND(g, h, a, b, c, d, e, f, (i) + 2, w[(i) + 2]); \
+    RND(f, g, h, a, b, c, d, e, (i) + 3, w[(i) + 3]); \
+    RND(e, f, g, h, a, b, c, d, (i) + 4, w[(i) + 4]); \
+    RND(d, e, f, g, h, a, b, c, (i) + 5, w[(i) + 5]); \
+    RND(c, d, e, f, g, h, a, b, (i) + 6, w[(i) + 6]); \
+    RND(b, c, d, e, f, g, h, a, (i) + 7, w[(i) + 7])
+
+#define RND8(i) \
+    RND(a, b, c, d, e, f, g, h, (i) + 0, W((i) + 0)); \
+    RND(h, a, b, c, d, e, f, g, (i) + 1, W((i) + 1)); \
+    RND(g, h, a, b, c, d, e, f, (i) + 2, W((i) + 2)); \
+    RND(f, g, h, a, b, c, d, e, (i) + 3, W((i) + 3)); \
+    RND(e, f, g, h, a, b, c, d, (i) + 4, W((i) + 4)); \
+    RND(d, e, f, g, h, a, b, c, (i) + 5, W((i) + 5)); \
+    RND(c, d, e, f, g, h, a, b, (i) + 6, W((i) + 6)); \
+    RND(b, c, d, e, f, g, h, a, (i) + 7, W((i) + 7))
+
+static const uint32_t sha_k[64] = { 0x428a2f98, 0x71374491, 0xb5c0fbcf,
+        0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98,
+        0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7,
+        0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f,
+        0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8,
+        0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85,
+        0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e,
+        0x92722c85, 0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819,
+        0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08, 0x2748774c,
+        0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3, 0x748f82ee,
+        0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7,
+        0xc67178f2 };
+
+static void sha_compress (uint32_t * p_state, const uint8_t * p_data);
+static uint32_t sha_get_be32 (const uint8_t * buf);
+#endif /* CBL_SHA256_SW == CBL_SHA256_BACKEND */
+
+/**
+ * @brief Starts a new digest
+ *
+ * @param p_ctx[out] Context of the digest
+ */
+void sha_init (sha_ctx_t * p_ctx)
+{
+#if CBL_SHA256_LIB == CBL_SHA256_BACKEND
+    sha256_init( &p_ctx->lib);
+#elif CBL_SHA256_SW == CBL_SHA256_BACKEND
+    p_ctx->state[0] = 0x6a09e667;
+    p_ctx->state[1] = 0xbb67ae85;
+    p_ctx->state[2] = 0x3c6ef372;
+    p_ctx->state[3] = 0xa54ff53a;
+    p_ctx->state[4] = 0x510e527f;
+    p_ctx->state[5] = 0x9b05688c;
+    p_ctx->state[6] = 0x1f83d9ab;
+    p_ctx->state[7] = 0x5be0cd19;
+    p_ctx->buf_len = 0;
+    p_ctx->len = 0;
+#else
+    p_ctx->buf_len = 0;
+    hal_sha256_start();
+#endif
+}
+
+/**
+ * @brief Accumulates bytes into the digest
+ *
+ * @param p_ctx[in,out] Context of the digest
+ * @param buf[in]       Bytes to accumulate
+ * @param len[in]       Length of 'buf'
+ */
+void sha_update (sha_ctx_t * p_ctx, const uint8_t * buf, uint32_t len)
+{
+#if CBL_SHA256_LIB == CBL_SHA256_BACKEND
+    sha256_update( &p_ctx->lib, buf, len);
+#elif CBL_SHA256_SW == CBL_SHA256_BACKEND
+    uint32_t fill;
+
+    p_ctx->len += len;
+
+    /* Complete the block left from the previous call */
+    if (p_ctx->buf_len > 0)
+    {
+        fill = SHA256_DATA_SZ - p_ctx->buf_len;
+        if (fill > len)
+        {
+            fill = len;
+        }
+
+        memcpy( &p_ctx->buf[p_ctx->buf_len], buf, fill);
+        p_ctx->buf_len += fill;
+        buf += fill;
+        len -= fill;
+
+        if (p_ctx->buf_len < SHA256_DATA_SZ)
+        {
+            return;
+        }
+
+        sha_compress(p_ctx->state, p_ctx->buf);
+        p_ctx->buf_len = 0;
+    }
+
+    /* Whole blocks are compressed where they are */
+    while (len >= SHA256_DATA_SZ)
+    {
+        sha_compress(p_ctx->state, buf);
+        buf += SHA256_DATA_SZ;
+        len -= SHA256_DATA_SZ;
+    }
+
+    memcpy(p_ctx->buf, buf, len);
+    p_ctx->buf_len = len;
+#else
+    uint32_t whole;
+
+    /* Peripheral takes whole words until the last call */
+    while (p_ctx->buf_len > 0 && p_ctx->buf_len < 4 && len > 0)
+    {
+        p_ctx->buf[p_ctx->buf_len++] = *buf++;
+        len--;
+    }
+
+    if (4 == p_ctx->buf_len)
+    {
+        hal_sha256_accumulate(p_ctx->buf, 4);
+        p_ctx->buf_len = 0;
+    }
+
+    whole = len & ~3u;
+    if (whole > 0)
+    {
+        hal_sha256_accumulate(buf, whole);
+    }
+
+    memcpy( &p_ctx->buf[p_ctx->buf_len], &buf[whole], len - whole);
+    p_ctx->buf_len += len - whole;
+#endif
+}
+
+/**
+ * @brief Finishes the digest
+ *
+ * @param p_ctx[in]     Context of the digest, shall be initialized again to
+ *                      be reused
+ * @param p_digest[out] Digest, SHA256_BLOCK_SIZE bytes
+ */
+void sha_final (sha_ctx_t * p_ctx, uint8_t * p_digest)
+{
+#if CBL_SHA256_LIB == CBL_SHA256_BACKEND
+    sha256_final( &p_ctx->lib, p_digest);
+#elif CBL_SHA256_SW == CBL_SHA256_BACKEND
+    uint64_t bits = p_ctx->len * 8u;
+
+    /* Padding is 0x80, zeroes and length in bits as big endian uint64 */
+    p_ctx->buf[p_ctx->buf_len++] = 0x80;
+
+    if (p_ctx->buf_len > SHA256_DATA_SZ - 8u)
+    {
+        memset( &p_ctx->buf[p_ctx->buf_len], 0,
+                SHA256_DATA_SZ - p_ctx->buf_len);
+        sha_compress(p_ctx->state, p_ctx->buf);
+        p_ctx->buf_len = 0;
+    }
+
+    memset( &p_ctx->buf[p_ctx->buf_len], 0,
+            SHA256_DATA_SZ - 8u - p_ctx->buf_len);
+
+    for (uint32_t iii = 0; iii < 8; iii++)
+    {
+        p_ctx->buf[SHA256_DATA_SZ - 1u - iii] = (uint8_t)(bits >> (8 * iii));
+    }
+
+    sha_compress(p_ctx->state, p_ctx->buf);
+
+    for (uint32_t iii = 0; iii < 8; iii++)
+    {
+        p_digest[4 * iii] = (uint8_t)(p_ctx->state[iii] >> 24);
+        p_digest[4 * iii + 1] = (uint8_t)(p_ctx->state[iii] >> 16);
+        p_digest[4 * iii + 2] = (uint8_t)(p_ctx->state[iii] >> 8);
+        p_digest[4 * iii + 3] = (uint8_t)p_ctx->state[iii];
+    }
+#else
+    hal_sha256_finish(p_ctx->buf, p_ctx->buf_len, p_digest);
+#endif
+}
+
+#if CBL_SHA256_SW == CBL_SHA256_BACKEND
+/**
+ * @brief Compresses one block into the state, all 64 rounds are unrolled
+ *
+ * @param p_state[in,out] Hash of blocks compressed so far
+ * @param p_data[in]      SHA256_DATA_SZ bytes, alignment doesn't matter
+ */
+static void sha_compress (uint32_t * p_state, const uint8_t * p_data)
+{
+    uint32_t w[16];
+    uint32_t a = p_state[0];
+    uint32_t b = p_state[1];
+    uint32_t c = p_state[2];
+    uint32_t d = p_state[3];
+    uint32_t e = p_state[4];
+    uint32_t f = p_state[5];
+    uint32_t g = p_state[6];
+    uint32_t h = p_state[7];
+
+    for (uint32_t iii = 0; iii < 16; iii++)
+    {
+        w[iii] = sha_get_be32( &p_data[4 * iii]);
+    }
+
+    RND8_FIRST(0);
+    RND8_FIRST(8);
+    RND8(16);
+    RND8(24);
+    RND8(32);
+    RND8(40);
+    RND8(48);
+    RND8(56);
+
+    p_state[0] += a;
+    p_state[1] += b;
+    p_state[2] += c;
+    p_state[3] += d;
+    p_state[4] += e;
+    p_state[5] += f;
+    p_state[6] += g;
+    p_state[7] += h;
+}
+
+/**
+ * @brief Reads big endian word from possibly unaligned buffer
+ */
+static uint32_t sha_get_be32 (const uint8_t * buf)
+{
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+    uint32_t word;
+
+    /* Unaligned load and one REV */
+    memcpy( &word, buf, sizeof(word));
+    return __REV(word);
+#else
+    return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16)
+            | ((uint32_t)buf[2] << 8) | (uint32_t)buf[3];
+#endif
+}
+#endif /* CBL_SHA256_SW == CBL_SHA256_BACKEND */
+
+/*** end of file ***/
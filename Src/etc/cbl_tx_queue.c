@@ -0,0 +1,154 @@
+/** @file cbl_tx_queue.c
+ *
+ * @brief Queue for bytes sent to the host. Main loop queues bytes, HAL
+ *        transmits them in the background and reports completion from the
+ *        interrupt.
+ */
+#include "etc/cbl_tx_queue.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TX_QUEUE_MASK (TX_QUEUE_SZ - 1u)
+
+#if (TX_QUEUE_SZ & TX_QUEUE_MASK) != 0
+#error "TX_QUEUE_SZ shall be power of 2"
+#endif
+
+/** Bytes waiting to be sent or being sent */
+static uint8_t tx_queue_buf[TX_QUEUE_SZ];
+/** Number of bytes ever queued, written only by the main loop */
+static volatile uint32_t tx_queue_head = 0;
+/** Number of bytes ever sent, written by the interrupt, or by the main loop
+ *  when transmission is not running */
+static volatile uint32_t tx_queue_tail = 0;
+/** Number of bytes being sent, 0 if transmission is not running */
+static volatile uint32_t tx_queue_busy_len = 0;
+
+static void tx_queue_kick (void);
+static bool tx_queue_has_space (uint32_t len);
+static bool tx_queue_is_empty (uint32_t arg);
+
+/**
+ * @brief Queues bytes to be sent to the host and starts transmission if it
+ *        isn't running. Waits only if the queue is full.
+ *
+ * @param buf[in] Bytes to send
+ * @param len[in] Number of bytes, can be more than TX_QUEUE_SZ
+ */
+cbl_err_code_t tx_queue_send (const char * buf, size_t len)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    while (len > 0)
+    {
+        uint32_t head = tx_queue_head;
+        uint32_t idx = head & TX_QUEUE_MASK;
+        uint32_t piece = ui32_min(len, TX_QUEUE_SZ / 2u);
+        uint32_t first_len;
+
+        eCode = wait_until(tx_queue_has_space, piece, CBL_TX_TIMEOUT_MS);
+        if (eCode != CBL_ERR_OK)
+        {
+            return CBL_ERR_HAL_TX;
+        }
+
+        /* Bytes can wrap around the end of the queue */
+        first_len = ui32_min(piece, TX_QUEUE_SZ - idx);
+
+        memcpy( &tx_queue_buf[idx], buf, first_len);
+        memcpy(tx_queue_buf, &buf[first_len], piece - first_len);
+
+        /* Publish the bytes only after they are copied in */
+        tx_queue_head = head + piece;
+
+        tx_queue_kick();
+
+        buf += piece;
+        len -= piece;
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Waits until all queued bytes are sent
+ */
+cbl_err_code_t tx_queue_flush (void)
+{
+    cbl_err_code_t eCode = CBL_ERR_OK;
+
+    eCode = wait_until(tx_queue_is_empty, 0, CBL_TX_TIMEOUT_MS);
+    if (eCode != CBL_ERR_OK)
+    {
+        return CBL_ERR_HAL_TX;
+    }
+
+    return eCode;
+}
+
+/**
+ * @brief Called by HAL from transmission complete interrupt. Starts sending
+ *        everything queued meanwhile.
+ */
+void tx_queue_isr_done (void)
+{
+    tx_queue_tail += tx_queue_busy_len;
+    tx_queue_busy_len = 0;
+
+    tx_queue_kick();
+}
+
+/**
+ * @brief Starts transmission of all queued bytes up to the end of the queue,
+ *        if transmission isn't running. Main loop calls it only after the
+ *        head is moved, so the interrupt never misses queued bytes.
+ */
+static void tx_queue_kick (void)
+{
+    uint32_t tail = tx_queue_tail;
+    uint32_t idx = tail & TX_QUEUE_MASK;
+    uint32_t len;
+
+    if (tx_queue_busy_len != 0)
+    {
+        /* Queued bytes are sent when the running transmission completes */
+        return;
+    }
+
+    len = ui32_min(tx_queue_head - tail, TX_QUEUE_SZ - idx);
+    if (0 == len)
+    {
+        return;
+    }
+
+    tx_queue_busy_len = len;
+
+    if (hal_send_to_host_start( &tx_queue_buf[idx], len) != CBL_ERR_OK)
+    {
+        /* Bytes are dropped, host sees a missing response */
+        tx_queue_busy_len = 0;
+        tx_queue_tail = tail + len;
+    }
+}
+
+/**
+ * @brief Checks if 'len' bytes fit into the queue
+ */
+static bool tx_queue_has_space (uint32_t len)
+{
+    return (TX_QUEUE_SZ - (tx_queue_head - tx_queue_tail)) >= len;
+}
+
+/**
+ * @brief Checks if all queued bytes are sent
+ */
+static bool tx_queue_is_empty (uint32_t arg)
+{
+    UNUSED(arg);
+
+    return tx_queue_head == tx_queue_tail && 0 == tx_queue_busy_len;
+}
+
+/*** end of file ***/
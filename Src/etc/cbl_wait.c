@@ -0,0 +1,38 @@
+/** @file cbl_wait.c
+ *
+ * @brief Waiting for completion flags raised from interrupts. Core sleeps
+ *        between checks instead of spinning.
+ */
+#include "etc/cbl_wait.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Sleeps until 'cond' is met or 'timeout_ms' passes. Condition is
+ *        checked after every interrupt.
+ *
+ * @param cond[in]       Condition to wait for
+ * @param arg[in]        Passed to 'cond'
+ * @param timeout_ms[in] Milliseconds to wait, WAIT_FOREVER to never time out
+ */
+cbl_err_code_t wait_until (wait_cond_t cond, uint32_t arg,
+        uint32_t timeout_ms)
+{
+    uint32_t start = hal_tick_get();
+
+    while (false == cond(arg))
+    {
+        /* Unsigned subtraction handles the tick wrapping */
+        if (timeout_ms != WAIT_FOREVER
+                && (hal_tick_get() - start) >= timeout_ms)
+        {
+            return CBL_ERR_RX_TIMEOUT;
+        }
+
+        hal_wait_for_event();
+    }
+
+    return CBL_ERR_OK;
+}
+
+/*** end of file ***/